@@ -0,0 +1,238 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <stdexcept>
+#include <boost/thread/tss.hpp>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+#include "blob_codec.h"
+
+namespace cryptonote
+{
+#ifdef HAVE_ZSTD
+  struct blob_codec::zstd_state
+  {
+    ZSTD_CCtx *cctx = nullptr;
+    ZSTD_CDict *cdict = nullptr;
+    ZSTD_DDict *ddict = nullptr;
+    unsigned dict_id = 0;
+    std::string dictionary;
+
+    ~zstd_state()
+    {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+      ZSTD_freeCCtx(cctx);
+    }
+  };
+
+  namespace
+  {
+    // a corrupt frame header must not make us allocate without bound
+    constexpr unsigned long long MAX_DECOMPRESSED_SIZE = 100 * 1024 * 1024;
+
+    void free_dctx(ZSTD_DCtx *dctx) { ZSTD_freeDCtx(dctx); }
+    boost::thread_specific_ptr<ZSTD_DCtx> thread_dctx(free_dctx);
+
+    ZSTD_DCtx *get_thread_dctx()
+    {
+      if (!thread_dctx.get())
+        thread_dctx.reset(ZSTD_createDCtx());
+      return thread_dctx.get();
+    }
+  }
+#else
+  struct blob_codec::zstd_state {};
+#endif
+
+  blob_codec::blob_codec(int level): m_level(level), m_zstd(new zstd_state())
+  {
+  }
+
+  blob_codec::~blob_codec()
+  {
+  }
+
+  bool blob_codec::available()
+  {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool blob_codec::train_dictionary(const std::vector<std::string> &samples, size_t max_size, std::string &dictionary)
+  {
+#ifdef HAVE_ZSTD
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto &sample: samples)
+    {
+      buffer.append(sample);
+      sizes.push_back(sample.size());
+    }
+    dictionary.resize(max_size);
+    const size_t size = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), buffer.data(), sizes.data(), (unsigned)sizes.size());
+    if (ZDICT_isError(size))
+    {
+      dictionary.clear();
+      return false;
+    }
+    dictionary.resize(size);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void blob_codec::set_dictionary(const std::string &dictionary)
+  {
+#ifdef HAVE_ZSTD
+    boost::unique_lock<boost::shared_mutex> lock(m_dictionary_mutex);
+    if (m_zstd->cdict)
+      throw std::runtime_error("blob_codec dictionary is already set");
+    ZSTD_CDict *cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), m_level);
+    ZSTD_DDict *ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+    // frames only record a non zero id, so a raw content dictionary would be silently skipped on decoding
+    const unsigned dict_id = ddict ? ZSTD_getDictID_fromDDict(ddict) : 0;
+    if (!cdict || !ddict || dict_id == 0)
+    {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+      throw std::runtime_error("Invalid blob_codec dictionary");
+    }
+    m_zstd->cdict = cdict;
+    m_zstd->ddict = ddict;
+    m_zstd->dict_id = dict_id;
+    m_zstd->dictionary = dictionary;
+#else
+    throw std::runtime_error("blob_codec dictionaries need zstd support");
+#endif
+  }
+
+  bool blob_codec::has_dictionary() const
+  {
+#ifdef HAVE_ZSTD
+    boost::shared_lock<boost::shared_mutex> lock(m_dictionary_mutex);
+    return m_zstd->cdict != nullptr;
+#else
+    return false;
+#endif
+  }
+
+  std::string blob_codec::get_dictionary() const
+  {
+#ifdef HAVE_ZSTD
+    boost::shared_lock<boost::shared_mutex> lock(m_dictionary_mutex);
+    return m_zstd->dictionary;
+#else
+    return std::string();
+#endif
+  }
+
+  void blob_codec::compress(const void *data, size_t size, std::string &out)
+  {
+#ifdef HAVE_ZSTD
+    boost::lock_guard<boost::mutex> lock(m_compress_mutex);
+    boost::shared_lock<boost::shared_mutex> dictionary_lock(m_dictionary_mutex);
+    if (!m_zstd->cctx)
+      m_zstd->cctx = ZSTD_createCCtx();
+    if (m_zstd->cctx)
+    {
+      out.resize(1 + ZSTD_compressBound(size));
+      const size_t csize = m_zstd->cdict ?
+          ZSTD_compress_usingCDict(m_zstd->cctx, &out[1], out.size() - 1, data, size, m_zstd->cdict) :
+          ZSTD_compressCCtx(m_zstd->cctx, &out[1], out.size() - 1, data, size, m_level);
+      if (!ZSTD_isError(csize) && csize < size)
+      {
+        out[0] = method_zstd;
+        out.resize(1 + csize);
+        return;
+      }
+    }
+#endif
+    out.resize(1 + size);
+    out[0] = method_raw;
+    if (size)
+      memcpy(&out[1], data, size);
+  }
+
+  bool blob_codec::decompress(const void *data, size_t size, std::string &out) const
+  {
+    if (size == 0)
+      return false;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+    switch (bytes[0])
+    {
+      case method_raw:
+        out.append(reinterpret_cast<const char*>(bytes + 1), size - 1);
+        return true;
+#ifdef HAVE_ZSTD
+      case method_zstd:
+      {
+        const unsigned long long dsize = ZSTD_getFrameContentSize(bytes + 1, size - 1);
+        if (dsize == ZSTD_CONTENTSIZE_UNKNOWN || dsize == ZSTD_CONTENTSIZE_ERROR || dsize > MAX_DECOMPRESSED_SIZE)
+          return false;
+        ZSTD_DCtx *dctx = get_thread_dctx();
+        if (!dctx)
+          return false;
+        const size_t offset = out.size();
+        out.resize(offset + dsize);
+        size_t result;
+        if (const unsigned dict_id = ZSTD_getDictID_fromFrame(bytes + 1, size - 1))
+        {
+          boost::shared_lock<boost::shared_mutex> lock(m_dictionary_mutex);
+          if (dict_id != m_zstd->dict_id)
+          {
+            out.resize(offset);
+            return false;
+          }
+          result = ZSTD_decompress_usingDDict(dctx, &out[offset], dsize, bytes + 1, size - 1, m_zstd->ddict);
+        }
+        else
+        {
+          result = ZSTD_decompressDCtx(dctx, &out[offset], dsize, bytes + 1, size - 1);
+        }
+        if (ZSTD_isError(result) || result != dsize)
+        {
+          out.resize(offset);
+          return false;
+        }
+        return true;
+      }
+#endif
+      default:
+        return false;
+    }
+  }
+}
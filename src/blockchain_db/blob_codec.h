@@ -0,0 +1,107 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace cryptonote
+{
+  /**
+   * @brief zstd compression for blobs stored in the database
+   *
+   * Every encoded blob starts with a one byte method, so a blob which does
+   * not shrink is kept as it is. A dictionary trained on earlier blobs can be
+   * set once it is available. Blobs compressed before that carry no
+   * dictionary id and stay readable.
+   *
+   * Without zstd support (HAVE_ZSTD) blobs are only ever stored raw, and
+   * compressed blobs cannot be decoded.
+   */
+  class blob_codec
+  {
+  public:
+    enum method: uint8_t
+    {
+      method_raw = 0,
+      method_zstd = 1,
+    };
+
+    explicit blob_codec(int level = DEFAULT_LEVEL);
+    ~blob_codec();
+
+    /**
+     * @brief whether this build can compress at all
+     */
+    static bool available();
+
+    /**
+     * @brief trains a dictionary of at most max_size bytes from samples
+     *
+     * @return false if zstd is not available or training failed
+     */
+    static bool train_dictionary(const std::vector<std::string> &samples, size_t max_size, std::string &dictionary);
+
+    /**
+     * @brief uses a dictionary for blobs compressed from now on
+     *
+     * May only be called once, and throws if the dictionary is unusable.
+     */
+    void set_dictionary(const std::string &dictionary);
+    bool has_dictionary() const;
+    std::string get_dictionary() const;
+
+    /**
+     * @brief encodes a blob into out, replacing its contents
+     */
+    void compress(const void *data, size_t size, std::string &out);
+
+    /**
+     * @brief decodes a blob and appends it to out
+     *
+     * Safe to call from several threads at once.
+     *
+     * @return false if the blob is corrupt or cannot be decoded by this build
+     */
+    bool decompress(const void *data, size_t size, std::string &out) const;
+
+    static constexpr int DEFAULT_LEVEL = 3;
+
+  private:
+    struct zstd_state;
+
+    int m_level;
+    std::unique_ptr<zstd_state> m_zstd;
+    boost::mutex m_compress_mutex;
+    mutable boost::shared_mutex m_dictionary_mutex;
+  };
+}
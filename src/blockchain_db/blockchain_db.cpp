@@ -46,7 +46,7 @@ namespace cryptonote
 {
 const command_line::arg_descriptor<std::string> arg_db_sync_mode = {
   "db-sync-mode"
-, "Specify sync option, using format [safe|fast|fastest]:[sync|async]:[<nblocks_per_sync>[blocks]|<nbytes_per_sync>[bytes]]."
+, "Specify sync option, using format [safe|fast|fastest]:[sync|async|writebehind]:[<nblocks_per_sync>[blocks]|<nbytes_per_sync>[bytes]]."
 , "fast:async:250000000bytes"
 };
 const command_line::arg_descriptor<bool> arg_db_salvage  = {
@@ -54,6 +54,11 @@ const command_line::arg_descriptor<bool> arg_db_salvage  = {
 , "Try to salvage a blockchain database if it seems corrupted"
 , false
 };
+const command_line::arg_descriptor<bool> arg_db_compress  = {
+  "db-compress"
+, "Compress transactions in a newly created blockchain database (needs zstd support)"
+, false
+};
 
 BlockchainDB *new_db()
 {
@@ -64,6 +69,7 @@ void BlockchainDB::init_options(boost::program_options::options_description& des
 {
   command_line::add_arg(desc, arg_db_sync_mode);
   command_line::add_arg(desc, arg_db_salvage);
+  command_line::add_arg(desc, arg_db_compress);
 }
 
 void BlockchainDB::pop_block()
@@ -292,6 +298,19 @@ bool BlockchainDB::get_pruned_tx(const crypto::hash& h, cryptonote::transaction
   return true;
 }
 
+bool BlockchainDB::get_rct_output_distribution(uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const
+{
+  distribution.clear();
+  if (to_height < from_height || to_height >= height())
+    return false;
+  std::vector<uint64_t> heights;
+  heights.reserve(to_height + 1 - from_height);
+  for (uint64_t h = from_height; h <= to_height; ++h)
+    heights.push_back(h);
+  distribution = get_block_cumulative_rct_outputs(heights);
+  return true;
+}
+
 transaction BlockchainDB::get_tx(const crypto::hash& h) const
 {
   transaction tx;
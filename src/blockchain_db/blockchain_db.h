@@ -105,6 +105,7 @@ typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<bool> arg_db_compress;
 
 #pragma pack(push, 1)
 
@@ -166,6 +167,13 @@ struct txpool_tx_meta_t
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
+// commits sync their data pages but not the meta page pointing at them, which
+// a background thread syncs instead, and each commit first waits for the
+// previous one to be flushed. So the db is never left corrupt: a process crash
+// loses nothing, and an OS crash or power loss can only roll back the last
+// commit.
+#define DBF_WRITE_BEHIND 0x20
+#define DBF_COMPRESS 0x40
 
 /***********************************
  * Exception Definitions
@@ -950,6 +958,21 @@ public:
    */
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const = 0;
 
+  /**
+   * @brief fetch the cumulative number of rct outputs for a range of blocks
+   *
+   * This is the same as calling get_block_cumulative_rct_outputs for every
+   * height in the range, but lets the subclass answer it from a table kept
+   * up to date as blocks are added and removed.
+   *
+   * @param from_height the first height requested
+   * @param to_height the last height requested (inclusive)
+   * @param distribution return-by-reference the cumulative rct outputs per height
+   *
+   * @return false if the range is empty or not in the blockchain, true otherwise
+   */
+  virtual bool get_rct_output_distribution(uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const;
+
   /**
    * @brief fetch the top block's timestamp
    *
@@ -1799,6 +1822,30 @@ public:
    */
   virtual uint64_t get_database_size() const = 0;
 
+  /**
+   * @brief get the hit and miss counts of the output data cache
+   *
+   * Backends without such a cache report zero for both.
+   *
+   * @param hits return-by-reference number of lookups served from the cache
+   * @param misses return-by-reference number of lookups which went to the db
+   */
+  virtual void get_output_cache_stats(uint64_t &hits, uint64_t &misses) const { hits = misses = 0; }
+
+  /**
+   * @brief get the latency of the most recent commit and disk flush
+   *
+   * The commit latency is how long the writer was held up committing its
+   * last write transaction. The flush latency is how long the last forced
+   * sync to disk took, which in write-behind mode runs off the writer thread.
+   *
+   * Backends which do not track this report zero for both.
+   *
+   * @param commit_us return-by-reference last commit latency, in microseconds
+   * @param flush_us return-by-reference last flush latency, in microseconds
+   */
+  virtual void get_commit_latency(uint64_t &commit_us, uint64_t &flush_us) const { commit_us = flush_us = 0; }
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -1867,6 +1914,29 @@ private:
   class db_rtxn_guard: public db_txn_guard { public: db_rtxn_guard(BlockchainDB *db): db_txn_guard(db, true) {} };
   class db_wtxn_guard: public db_txn_guard { public: db_wtxn_guard(BlockchainDB *db): db_txn_guard(db, false) {} };
 
+/**
+ * @brief a consistent read-only view of the database for the calling thread
+ *
+ * Every read made by this thread while the snapshot is alive sees the same
+ * committed state, so read-only callers (RPC handlers in particular) can use
+ * it instead of the Blockchain lock and keep running while a block is being
+ * added. Snapshots nest: an inner one reuses the outer read txn. They pin old
+ * pages in the database, so keep them short-lived, and never take the
+ * Blockchain lock while holding one.
+ */
+class db_snapshot
+{
+public:
+  db_snapshot(const BlockchainDB *db): db(db), active(db->block_rtxn_start()) {}
+  ~db_snapshot() { if (active) db->block_rtxn_stop(); }
+  db_snapshot(const db_snapshot&) = delete;
+  db_snapshot &operator=(const db_snapshot&) = delete;
+
+private:
+  const BlockchainDB *db;
+  const bool active;
+};
+
 BlockchainDB *new_db();
 
 }  // namespace cryptonote
@@ -0,0 +1,250 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include "key_image_filter.h"
+
+#define KEY_IMAGE_FILTER_MAGIC "kifilt01"
+#define KEY_IMAGE_FILTER_MIN_BUCKETS 1024
+#define KEY_IMAGE_FILTER_MAX_LOAD 0.9
+#define KEY_IMAGE_FILTER_MAX_KICKS 500
+
+namespace
+{
+  uint64_t mix64(uint64_t z)
+  {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  void append_u64(std::string &s, uint64_t v)
+  {
+    s.append((const char*)&v, sizeof(v));
+  }
+
+  bool read_u64(const std::string &s, size_t &offset, uint64_t &v)
+  {
+    if (s.size() - offset < sizeof(v))
+      return false;
+    memcpy(&v, s.data() + offset, sizeof(v));
+    offset += sizeof(v);
+    return true;
+  }
+}
+
+namespace cryptonote
+{
+//---------------------------------------------------------------
+key_image_filter::key_image_filter(size_t capacity):
+  m_count(0),
+  m_salt(crypto::rand<uint64_t>()),
+  m_victim_used(false),
+  m_victim_bucket(0),
+  m_victim_fingerprint(0)
+{
+  size_t n_buckets = KEY_IMAGE_FILTER_MIN_BUCKETS;
+  while (n_buckets * SLOTS_PER_BUCKET * KEY_IMAGE_FILTER_MAX_LOAD < capacity)
+    n_buckets <<= 1;
+  m_slots.resize(n_buckets * SLOTS_PER_BUCKET, 0);
+  m_bucket_mask = n_buckets - 1;
+  m_rng = m_salt;
+}
+//---------------------------------------------------------------
+void key_image_filter::hash(const crypto::key_image &ki, size_t &bucket, uint16_t &fingerprint) const
+{
+  uint64_t w[4];
+  static_assert(sizeof(w) == sizeof(ki), "Unexpected key image size");
+  memcpy(w, &ki, sizeof(w));
+  bucket = mix64(w[0] ^ w[2] ^ m_salt) & m_bucket_mask;
+  fingerprint = mix64(w[1] ^ w[3] ^ ~m_salt) & 0xffff;
+  if (fingerprint == 0) // 0 marks an empty slot
+    fingerprint = 1;
+}
+//---------------------------------------------------------------
+size_t key_image_filter::alt_bucket(size_t bucket, uint16_t fingerprint) const
+{
+  // involutive, so either bucket maps to the other one
+  return (bucket ^ mix64(fingerprint)) & m_bucket_mask;
+}
+//---------------------------------------------------------------
+bool key_image_filter::insert_into(size_t bucket, uint16_t fingerprint)
+{
+  uint16_t *slots = &m_slots[bucket * SLOTS_PER_BUCKET];
+  for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i)
+  {
+    if (slots[i] == 0)
+    {
+      slots[i] = fingerprint;
+      return true;
+    }
+  }
+  return false;
+}
+//---------------------------------------------------------------
+bool key_image_filter::bucket_contains(size_t bucket, uint16_t fingerprint) const
+{
+  const uint16_t *slots = &m_slots[bucket * SLOTS_PER_BUCKET];
+  for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i)
+    if (slots[i] == fingerprint)
+      return true;
+  return false;
+}
+//---------------------------------------------------------------
+bool key_image_filter::remove_from(size_t bucket, uint16_t fingerprint)
+{
+  uint16_t *slots = &m_slots[bucket * SLOTS_PER_BUCKET];
+  for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i)
+  {
+    if (slots[i] == fingerprint)
+    {
+      slots[i] = 0;
+      return true;
+    }
+  }
+  return false;
+}
+//---------------------------------------------------------------
+bool key_image_filter::insert(const crypto::key_image &ki)
+{
+  if (m_victim_used)
+    return false;
+
+  size_t bucket;
+  uint16_t fingerprint;
+  hash(ki, bucket, fingerprint);
+  const size_t bucket2 = alt_bucket(bucket, fingerprint);
+  if (insert_into(bucket, fingerprint) || insert_into(bucket2, fingerprint))
+  {
+    ++m_count;
+    return true;
+  }
+
+  // both buckets are full, kick fingerprints around until one finds room
+  m_rng = mix64(m_rng);
+  if (m_rng & 1)
+    bucket = bucket2;
+  for (size_t kick = 0; kick < KEY_IMAGE_FILTER_MAX_KICKS; ++kick)
+  {
+    m_rng = mix64(m_rng);
+    std::swap(fingerprint, m_slots[bucket * SLOTS_PER_BUCKET + m_rng % SLOTS_PER_BUCKET]);
+    bucket = alt_bucket(bucket, fingerprint);
+    if (insert_into(bucket, fingerprint))
+    {
+      ++m_count;
+      return true;
+    }
+  }
+
+  m_victim_used = true;
+  m_victim_bucket = bucket;
+  m_victim_fingerprint = fingerprint;
+  ++m_count;
+  return true;
+}
+//---------------------------------------------------------------
+bool key_image_filter::remove(const crypto::key_image &ki)
+{
+  size_t bucket;
+  uint16_t fingerprint;
+  hash(ki, bucket, fingerprint);
+  const size_t bucket2 = alt_bucket(bucket, fingerprint);
+  if (remove_from(bucket, fingerprint) || remove_from(bucket2, fingerprint))
+  {
+    --m_count;
+    if (m_victim_used)
+    {
+      // there is room now, though not necessarily in the victim's buckets
+      const size_t victim_bucket2 = alt_bucket(m_victim_bucket, m_victim_fingerprint);
+      if (insert_into(m_victim_bucket, m_victim_fingerprint) || insert_into(victim_bucket2, m_victim_fingerprint))
+        m_victim_used = false;
+    }
+    return true;
+  }
+  if (m_victim_used && m_victim_fingerprint == fingerprint && (m_victim_bucket == bucket || m_victim_bucket == bucket2))
+  {
+    m_victim_used = false;
+    --m_count;
+    return true;
+  }
+  return false;
+}
+//---------------------------------------------------------------
+bool key_image_filter::may_contain(const crypto::key_image &ki) const
+{
+  size_t bucket;
+  uint16_t fingerprint;
+  hash(ki, bucket, fingerprint);
+  const size_t bucket2 = alt_bucket(bucket, fingerprint);
+  if (bucket_contains(bucket, fingerprint) || bucket_contains(bucket2, fingerprint))
+    return true;
+  return m_victim_used && m_victim_fingerprint == fingerprint && (m_victim_bucket == bucket || m_victim_bucket == bucket2);
+}
+//---------------------------------------------------------------
+std::string key_image_filter::serialize() const
+{
+  std::string s = KEY_IMAGE_FILTER_MAGIC;
+  s.reserve(s.size() + 6 * sizeof(uint64_t) + m_slots.size() * sizeof(uint16_t));
+  append_u64(s, m_bucket_mask + 1);
+  append_u64(s, m_count);
+  append_u64(s, m_salt);
+  append_u64(s, m_victim_used);
+  append_u64(s, m_victim_bucket);
+  append_u64(s, m_victim_fingerprint);
+  s.append((const char*)m_slots.data(), m_slots.size() * sizeof(uint16_t));
+  return s;
+}
+//---------------------------------------------------------------
+bool key_image_filter::deserialize(const std::string &data)
+{
+  const size_t magic_size = strlen(KEY_IMAGE_FILTER_MAGIC);
+  if (data.size() < magic_size || data.compare(0, magic_size, KEY_IMAGE_FILTER_MAGIC))
+    return false;
+  size_t offset = magic_size;
+  uint64_t n_buckets, count, salt, victim_used, victim_bucket, victim_fingerprint;
+  if (!read_u64(data, offset, n_buckets) || !read_u64(data, offset, count) || !read_u64(data, offset, salt)
+      || !read_u64(data, offset, victim_used) || !read_u64(data, offset, victim_bucket) || !read_u64(data, offset, victim_fingerprint))
+    return false;
+  if (n_buckets == 0 || (n_buckets & (n_buckets - 1)) || victim_bucket >= n_buckets || victim_fingerprint > 0xffff)
+    return false;
+  if ((data.size() - offset) / sizeof(uint16_t) / SLOTS_PER_BUCKET != n_buckets || (data.size() - offset) % (sizeof(uint16_t) * SLOTS_PER_BUCKET))
+    return false;
+
+  m_slots.resize(n_buckets * SLOTS_PER_BUCKET);
+  memcpy(m_slots.data(), data.data() + offset, m_slots.size() * sizeof(uint16_t));
+  m_bucket_mask = n_buckets - 1;
+  m_count = count;
+  m_salt = salt;
+  m_rng = mix64(salt ^ count);
+  m_victim_used = victim_used != 0;
+  m_victim_bucket = victim_bucket;
+  m_victim_fingerprint = victim_fingerprint;
+  return true;
+}
+//---------------------------------------------------------------
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "crypto/crypto.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief a cuckoo filter over spent key images
+   *
+   * Answers whether a key image may be in the set, with no false negatives
+   * and a false positive rate around 0.01%. Each key image takes a 16 bit
+   * fingerprint, stored in one of two buckets of four slots. Bucket indices
+   * are derived from the key image mixed with a random salt, so key images
+   * cannot be ground to pile up in the same buckets.
+   *
+   * Removing a key image which was not inserted may remove another one's
+   * fingerprint, so callers must only remove what they inserted.
+   */
+  class key_image_filter
+  {
+  public:
+    /**
+     * @brief creates a filter able to hold at least capacity key images
+     */
+    explicit key_image_filter(size_t capacity = 0);
+
+    /**
+     * @brief adds a key image
+     *
+     * @return false if the filter is full, in which case the key image was
+     * not added and the filter should be rebuilt larger
+     */
+    bool insert(const crypto::key_image &ki);
+
+    /**
+     * @brief removes a key image previously inserted
+     *
+     * @return false if no matching fingerprint was found
+     */
+    bool remove(const crypto::key_image &ki);
+
+    /**
+     * @brief checks whether a key image may have been inserted
+     *
+     * @return false if it definitely was not
+     */
+    bool may_contain(const crypto::key_image &ki) const;
+
+    size_t size() const { return m_count; }
+    size_t capacity() const { return m_slots.size(); }
+
+    std::string serialize() const;
+    bool deserialize(const std::string &data);
+
+  private:
+    static constexpr size_t SLOTS_PER_BUCKET = 4;
+
+    void hash(const crypto::key_image &ki, size_t &bucket, uint16_t &fingerprint) const;
+    size_t alt_bucket(size_t bucket, uint16_t fingerprint) const;
+    bool insert_into(size_t bucket, uint16_t fingerprint);
+    bool bucket_contains(size_t bucket, uint16_t fingerprint) const;
+    bool remove_from(size_t bucket, uint16_t fingerprint);
+
+    std::vector<uint16_t> m_slots;
+    size_t m_bucket_mask;
+    size_t m_count;
+    uint64_t m_salt;
+    uint64_t m_rng;
+
+    // a fingerprint that was kicked out with nowhere to go, kept so nothing is lost
+    bool m_victim_used;
+    size_t m_victim_bucket;
+    uint16_t m_victim_fingerprint;
+  };
+}
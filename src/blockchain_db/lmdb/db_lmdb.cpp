@@ -31,6 +31,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/circular_buffer.hpp>
+#include <boost/thread/lock_types.hpp>
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
 
@@ -57,6 +58,8 @@ using namespace crypto;
 // Increase when the DB structure changes
 #define VERSION 4
 
+#define DEFAULT_OUTPUT_CACHE_SIZE (64 * 1024 * 1024)
+
 namespace
 {
 
@@ -534,6 +537,9 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  // the map must not move under a background flush
+  wait_for_flush();
+
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
@@ -812,6 +818,8 @@ void BlockchainLMDB::remove_block()
 
   // must use h now; deleting from m_block_info will invalidate it
   mdb_block_info *bi = (mdb_block_info *)h.mv_data;
+  truncate_rct_distribution(m_height - 1);
+  m_rct_distribution_removed_height = std::min(m_rct_distribution_removed_height, m_height - 1);
   blk_height bh = {bi->bi_hash, 0};
   h.mv_data = (void *)&bh;
   h.mv_size = sizeof(bh);
@@ -884,15 +892,8 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (unprunable_size > blob.size())
     throw0(DB_ERROR("pruned tx size is larger than tx size"));
 
-  MDB_val pruned_blob = {unprunable_size, (void*)blob.data()};
-  result = mdb_cursor_put(m_cur_txs_pruned, &val_tx_id, &pruned_blob, MDB_APPEND);
-  if (result)
-    throw0(DB_ERROR(lmdb_error("Failed to add pruned tx blob to db transaction: ", result).c_str()));
-
-  MDB_val prunable_blob = {blob.size() - unprunable_size, (void*)(blob.data() + unprunable_size)};
-  result = mdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
-  if (result)
-    throw0(DB_ERROR(lmdb_error("Failed to add prunable tx blob to db transaction: ", result).c_str()));
+  put_tx_blob(m_cur_txs_pruned, &val_tx_id, blob.data(), unprunable_size, "pruned");
+  put_tx_blob(m_cur_txs_prunable, &val_tx_id, blob.data() + unprunable_size, blob.size() - unprunable_size, "prunable");
 
   if (get_blockchain_pruning_seed())
   {
@@ -1120,6 +1121,13 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   else if (result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to get an output", result).c_str()));
 
+  if (amount == 0)
+  {
+    // the index may be reused by another output before the txn is committed
+    m_output_cache_dirty = true;
+    m_output_cache.invalidate();
+  }
+
   const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
   MDB_val_set(otxk, ok->output_id);
   result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
@@ -1210,6 +1218,17 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+
+  // added right away: if the txn is aborted, this is only a false positive
+  boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+  if (m_key_image_filter && !m_key_image_filter->insert(k_image))
+  {
+    MINFO("Spent key image filter is full, it will be rebuilt larger");
+    m_key_image_filter.reset();
+    m_key_image_filter_rebuild = true;
+  }
+  else if (m_key_image_filter_building)
+    m_key_image_filter_added_since.push_back(k_image);
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -1229,6 +1248,7 @@ void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
     result = mdb_cursor_del(m_cur_spent_keys, 0);
     if (result)
         throw1(DB_ERROR(lmdb_error("Error adding removal of key image to db transaction", result).c_str()));
+    m_key_image_filter_removals.push_back(k_image);
   }
 }
 
@@ -1246,7 +1266,9 @@ BlockchainLMDB::~BlockchainLMDB()
     close();
 }
 
-BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
+BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB(),
+  m_output_cache(DEFAULT_OUTPUT_CACHE_SIZE),
+  m_write_behind([this](){ return flush(); })
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   // initialize folder to something "safe" just in case
@@ -1259,6 +1281,16 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_key_image_filter_rebuild = false;
+  m_key_image_filter_building = false;
+  m_output_cache_dirty = false;
+  m_output_cache_height = 0;
+  m_output_cache_min_txnid = 0;
+  m_rct_distribution_min_txnid = 0;
+  m_rct_distribution_removed_height = std::numeric_limits<uint64_t>::max();
+  m_commit_latency_us = 0;
+  m_flush_latency_us = 0;
+  m_blob_dictionary_sample_bytes = 0;
 
   // reset may also need changing when initialize things here
 
@@ -1329,6 +1361,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     mdb_flags |= MDB_NOSYNC;
   if (db_flags & DBF_FASTEST)
     mdb_flags |= MDB_NOSYNC | MDB_WRITEMAP | MDB_MAPASYNC;
+  if (db_flags & DBF_WRITE_BEHIND)
+    mdb_flags |= MDB_NOMETASYNC;
   if (db_flags & DBF_RDONLY)
     mdb_flags = MDB_RDONLY;
   if (db_flags & DBF_SALVAGE)
@@ -1432,6 +1466,42 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   LOG_PRINT_L2("Setting m_height to: " << db_stats.ms_entries);
   uint64_t m_height = db_stats.ms_entries;
 
+  // whether tx blobs are compressed is decided when the db is created
+  m_blob_codec.reset();
+  m_blob_dictionary_samples.clear();
+  m_blob_dictionary_sample_bytes = 0;
+  MDB_val_str(kc, "blob_compression");
+  MDB_val vc;
+  if (mdb_get(txn, m_properties, &kc, &vc) == MDB_SUCCESS)
+  {
+    if (!blob_codec::available())
+    {
+      txn.abort();
+      mdb_env_close(m_env);
+      m_open = false;
+      MFATAL("Existing lmdb database is compressed, but this build has no zstd support.");
+      return;
+    }
+    m_blob_codec.reset(new blob_codec());
+    MDB_val_str(kd, "blob_dictionary");
+    if (mdb_get(txn, m_properties, &kd, &vc) == MDB_SUCCESS)
+      m_blob_codec->set_dictionary(std::string((const char*)vc.mv_data, vc.mv_size));
+  }
+  else if ((db_flags & DBF_COMPRESS) && m_height == 0 && !(mdb_flags & MDB_RDONLY))
+  {
+    if (!blob_codec::available())
+      throw0(DB_ERROR("Database compression was requested, but this build has no zstd support"));
+    MDB_val_copy<uint32_t> vm(blob_codec::method_zstd);
+    if (auto result = mdb_put(txn, m_properties, &kc, &vm, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write compression method to database: ", result).c_str()));
+    m_blob_codec.reset(new blob_codec());
+    MGINFO("Creating a compressed database");
+  }
+  else if (db_flags & DBF_COMPRESS)
+  {
+    MWARNING("The existing database is not compressed: import it into a new one with --db-compress to compress it");
+  }
+
   bool compatible = true;
 
   MDB_val_str(k, "version");
@@ -1463,6 +1533,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      load_key_image_filter();
+      start_flush_thread(db_flags);
       return;
     }
 #endif
@@ -1509,6 +1581,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+  load_key_image_filter();
+  start_flush_thread(db_flags);
   // from here, init should be finished
 }
 
@@ -1520,7 +1594,11 @@ void BlockchainLMDB::close()
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
     batch_abort();
   }
+  stop_flush_thread();
+  join_key_image_filter_builder();
   this->sync();
+  try { store_key_image_filter(); }
+  catch (const std::exception &e) { MWARNING("Failed to save spent key image filter: " << e.what()); }
   m_tinfo.reset();
 
   // FIXME: not yet thread safe!!!  Use with care.
@@ -1538,14 +1616,120 @@ void BlockchainLMDB::sync()
 
   // Does nothing unless LMDB environment was opened with MDB_NOSYNC or in part
   // MDB_NOMETASYNC. Force flush to be synchronous.
+  TIME_MEASURE_NS_START(flush_time);
   if (auto result = mdb_env_sync(m_env, true))
   {
     throw0(DB_ERROR(lmdb_error("Failed to sync database: ", result).c_str()));
   }
+  TIME_MEASURE_NS_FINISH(flush_time);
+  m_flush_latency_us = flush_time / 1000;
+}
+
+int BlockchainLMDB::flush()
+{
+  TIME_MEASURE_NS_START(flush_time);
+  const int result = mdb_env_sync(m_env, true);
+  TIME_MEASURE_NS_FINISH(flush_time);
+  m_flush_latency_us = flush_time / 1000;
+  return result;
+}
+
+void BlockchainLMDB::start_flush_thread(const int db_flags)
+{
+  if (!(db_flags & DBF_WRITE_BEHIND) || (db_flags & DBF_RDONLY))
+    return;
+  MINFO("Flushing commits to disk in the background");
+  m_write_behind.start();
+}
+
+void BlockchainLMDB::stop_flush_thread()
+{
+  if (const int result = m_write_behind.stop())
+    MERROR(lmdb_error("Failed to flush the last commit to disk: ", result));
+}
+
+void BlockchainLMDB::wait_for_flush()
+{
+  if (const int result = m_write_behind.wait())
+    throw0(DB_ERROR(lmdb_error("Failed to flush the previous commit to disk: ", result).c_str()));
+}
+
+void BlockchainLMDB::queue_flush()
+{
+  m_write_behind.queue();
+}
+
+void BlockchainLMDB::put_tx_blob(MDB_cursor *cursor, MDB_val *key, const char *data, size_t size, const char *what)
+{
+  MDB_val v = {size, (void*)data};
+  std::string encoded;
+  if (m_blob_codec)
+  {
+    if (m_blob_dictionary_sample_bytes < BLOB_DICTIONARY_SAMPLE_BYTES && !m_blob_codec->has_dictionary())
+    {
+      m_blob_dictionary_samples.emplace_back(data, size);
+      m_blob_dictionary_sample_bytes += size;
+    }
+    m_blob_codec->compress(data, size, encoded);
+    v.mv_size = encoded.size();
+    v.mv_data = (void*)encoded.data();
+  }
+  if (auto result = mdb_cursor_put(cursor, key, &v, MDB_APPEND))
+    throw0(DB_ERROR(lmdb_error(std::string("Failed to add ") + what + " tx blob to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::append_tx_blob(const MDB_val &v, cryptonote::blobdata &bd) const
+{
+  if (!m_blob_codec)
+    bd.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+  else if (!m_blob_codec->decompress(v.mv_data, v.mv_size, bd))
+    throw0(DB_ERROR("Failed to decompress tx blob"));
+}
+
+void BlockchainLMDB::train_blob_dictionary()
+{
+  if (!m_blob_codec || m_blob_dictionary_sample_bytes < BLOB_DICTIONARY_SAMPLE_BYTES || m_blob_dictionary_samples.empty())
+    return;
+
+  std::vector<std::string> samples;
+  samples.swap(m_blob_dictionary_samples);
+  std::string dictionary;
+  if (!blob_codec::train_dictionary(samples, BLOB_DICTIONARY_SIZE, dictionary))
+  {
+    MWARNING("Failed to train a tx compression dictionary, compressing without one");
+    return;
+  }
+
+  // the dictionary is only used once it is committed, so an aborted batch can't leave blobs we can't read
+  mdb_txn_safe txn;
+  if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  MDB_val_str(k, "blob_dictionary");
+  MDB_val v = {dictionary.size(), (void*)dictionary.data()};
+  if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to write compression dictionary to database: ", result).c_str()));
+  wait_for_flush();
+  txn.commit();
+  queue_flush();
+  m_blob_codec->set_dictionary(dictionary);
+  MGINFO("Trained a " << dictionary.size() << " byte tx compression dictionary from " << samples.size() << " blobs");
+}
+
+void BlockchainLMDB::get_commit_latency(uint64_t &commit_us, uint64_t &flush_us) const
+{
+  commit_us = m_commit_latency_us;
+  flush_us = m_flush_latency_us;
 }
 
 void BlockchainLMDB::safesyncmode(const bool onoff)
 {
+  // write-behind must keep syncing data pages before the meta page
+  unsigned int flags;
+  if (mdb_env_get_flags(m_env, &flags) == 0 && (flags & MDB_NOMETASYNC))
+  {
+    MINFO("keeping write-behind sync mode");
+    return;
+  }
   MINFO("switching safe mode " << (onoff ? "on" : "off"));
   mdb_env_set_flags(m_env, MDB_NOSYNC|MDB_MAPASYNC, !onoff);
 }
@@ -1554,6 +1738,7 @@ void BlockchainLMDB::reset()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  wait_for_flush();
 
   mdb_txn_safe txn;
   if (auto result = lmdb_txn_begin(m_env, NULL, 0, txn))
@@ -1595,9 +1780,29 @@ void BlockchainLMDB::reset()
   if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
+  // an emptied compressed db stays compressed
+  if (m_blob_codec)
+  {
+    MDB_val_str(kc, "blob_compression");
+    MDB_val_copy<uint32_t> vc(blob_codec::method_zstd);
+    if (auto result = mdb_put(txn, m_properties, &kc, &vc, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write compression method to database: ", result).c_str()));
+    if (m_blob_codec->has_dictionary())
+    {
+      const std::string dictionary = m_blob_codec->get_dictionary();
+      MDB_val_str(kd, "blob_dictionary");
+      MDB_val vd = {dictionary.size(), (void*)dictionary.data()};
+      if (auto result = mdb_put(txn, m_properties, &kd, &vd, 0))
+        throw0(DB_ERROR(lmdb_error("Failed to write compression dictionary to database: ", result).c_str()));
+    }
+  }
+
   txn.commit();
   m_cum_size = 0;
   m_cum_count = 0;
+  m_output_cache.invalidate();
+  truncate_rct_distribution(0);
+  rebuild_key_image_filter();
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -1676,7 +1881,11 @@ void BlockchainLMDB::unlock()
 #define TXN_POSTFIX_SUCCESS() \
   do { \
     if (! m_batch_active) \
+    { \
+      wait_for_flush(); \
       auto_txn.commit(); \
+      queue_flush(); \
+    } \
   } while(0)
 
 
@@ -1702,7 +1911,11 @@ void BlockchainLMDB::unlock()
 #define TXN_BLOCK_POSTFIX_SUCCESS() \
   do { \
     if (! m_batch_active && ! m_write_txn) \
+    { \
+      wait_for_flush(); \
       auto_txn.commit(); \
+      queue_flush(); \
+    } \
   } while(0)
 
 void BlockchainLMDB::add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata &blob, const txpool_tx_meta_t &meta)
@@ -1920,12 +2133,21 @@ uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
   return pruning_seed;
 }
 
-static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
+static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id, const blob_codec *codec)
 {
   MDB_val v;
   int ret = mdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
   if (ret)
     throw0(DB_ERROR(lmdb_error("Failed to find transaction pruned data: ", ret).c_str()));
+  if (codec)
+  {
+    cryptonote::blobdata bd;
+    if (!codec->decompress(v.mv_data, v.mv_size, bd))
+      throw0(DB_ERROR("Failed to decompress transaction pruned data"));
+    if (bd.empty())
+      throw0(DB_ERROR("Invalid transaction pruned data"));
+    return cryptonote::is_v1_tx(bd);
+  }
   if (v.mv_size == 0)
     throw0(DB_ERROR("Invalid transaction pruned data"));
   return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
@@ -1944,6 +2166,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
     throw0(DB_ERROR("Pruning seed not in range"));
   check_open();
 
+  wait_for_flush(); // don't commit over a state which is still being flushed
   TIME_MEASURE_START(t);
 
   size_t n_total_records = 0, n_prunable_records = 0, n_pruned_records = 0, commit_counter = 0;
@@ -2037,7 +2260,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
       if (block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS < blockchain_height)
       {
         ++n_total_records;
-        if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &k))
+        if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &k, m_blob_codec.get()))
         {
           ++n_prunable_records;
           result = mdb_cursor_get(c_txs_prunable, &k, &v, MDB_SET);
@@ -2123,7 +2346,7 @@ bool BlockchainLMDB::prune_worker(int mode, uint32_t pruning_seed)
         }
       }
       MDB_val_set(kp, ti.data.tx_id);
-      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &kp))
+      if (!tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) && !is_v1_tx(c_txs_pruned, &kp, m_blob_codec.get()))
       {
         result = mdb_cursor_get(c_txs_prunable, &kp, &v, MDB_SET);
         if (result && result != MDB_NOTFOUND)
@@ -2507,6 +2730,66 @@ std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std
   return res;
 }
 
+bool BlockchainLMDB::get_rct_output_distribution(uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  distribution.clear();
+  if (to_height < from_height)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  if (to_height >= height())
+    return false;
+
+  // a writer sees its own uncommitted blocks, and an older snapshot may see
+  // blocks since removed: both read from the db without touching the table
+  const bool in_writer = m_write_txn && m_writer == boost::this_thread::get_id();
+  const uint64_t txnid = mdb_txn_id(m_txn);
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_rct_distribution_mutex);
+    if (!in_writer && txnid >= m_rct_distribution_min_txnid && m_rct_distribution.size() > to_height)
+    {
+      distribution.assign(m_rct_distribution.begin() + from_height, m_rct_distribution.begin() + to_height + 1);
+      return true;
+    }
+  }
+
+  std::vector<uint64_t> heights;
+
+  boost::unique_lock<boost::shared_mutex> lock(m_rct_distribution_mutex);
+  if (in_writer || txnid < m_rct_distribution_min_txnid)
+  {
+    lock.unlock();
+    heights.reserve(to_height + 1 - from_height);
+    for (uint64_t h = from_height; h <= to_height; ++h)
+      heights.push_back(h);
+    distribution = get_block_cumulative_rct_outputs(heights);
+    return true;
+  }
+
+  if (m_rct_distribution.size() <= to_height)
+  {
+    heights.reserve(to_height + 1 - m_rct_distribution.size());
+    for (uint64_t h = m_rct_distribution.size(); h <= to_height; ++h)
+      heights.push_back(h);
+    const std::vector<uint64_t> tail = get_block_cumulative_rct_outputs(heights);
+    m_rct_distribution.insert(m_rct_distribution.end(), tail.begin(), tail.end());
+  }
+  distribution.assign(m_rct_distribution.begin() + from_height, m_rct_distribution.begin() + to_height + 1);
+
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
+void BlockchainLMDB::truncate_rct_distribution(uint64_t height)
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_rct_distribution_mutex);
+  if (m_rct_distribution.size() > height)
+    m_rct_distribution.resize(height);
+}
+
 uint64_t BlockchainLMDB::get_top_block_timestamp() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2978,8 +3261,9 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  bd.clear();
+  append_tx_blob(result0, bd);
+  append_tx_blob(result1, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3009,7 +3293,8 @@ bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_tx_blob(result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3050,7 +3335,8 @@ bool BlockchainLMDB::get_pruned_tx_blobs_from(const crypto::hash& h, size_t coun
       return false;
     if (res)
       throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx blob", res).c_str()));
-    bd.emplace_back(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+    bd.emplace_back();
+    append_tx_blob(result, bd.back());
   }
 
   TXN_POSTFIX_RDONLY();
@@ -3137,14 +3423,14 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_count, si
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      tx_blob.assign((const char*)v.mv_data, v.mv_size);
+      append_tx_blob(v, tx_blob);
 
       if (!pruned)
       {
         result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        append_tx_blob(v, tx_blob);
       }
       current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
       size += current_block.second.back().second.size();
@@ -3179,7 +3465,8 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_tx_blob(result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3300,6 +3587,11 @@ uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
   check_open();
 
   TXN_PREFIX_RDONLY();
+
+  output_data_t ret;
+  if (amount == 0 && get_cached_output(m_txn, index, ret))
+    return ret;
+
   RCURSOR(output_amounts);
 
   MDB_val_set(k, amount);
@@ -3311,11 +3603,11 @@ uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
   else if (get_result)
     throw0(DB_ERROR("Error attempting to retrieve an output pubkey from the db"));
 
-  output_data_t ret;
   if (amount == 0)
   {
     const outkey *okp = (const outkey *)v.mv_data;
     ret = okp->data;
+    cache_output(m_txn, index, ret);
   }
   else
   {
@@ -3413,6 +3705,12 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+    if (m_key_image_filter && !m_key_image_filter->may_contain(img))
+      return false;
+  }
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -3458,6 +3756,273 @@ bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_ima
   return fret;
 }
 
+std::string BlockchainLMDB::get_key_image_filter_file() const
+{
+  return (boost::filesystem::path(m_folder) / "spent_keys.filter").string();
+}
+
+uint64_t BlockchainLMDB::num_spent_keys() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  int result;
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_spent_keys, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+
+  TXN_POSTFIX_RDONLY();
+
+  return db_stats.ms_entries;
+}
+
+void BlockchainLMDB::load_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // the saved filter is only used if it was saved on the chain state we are at
+  std::string data;
+  const std::string filename = get_key_image_filter_file();
+  if (boost::filesystem::exists(filename) && epee::file_io_utils::load_file_to_string(filename, data)
+      && data.size() > sizeof(crypto::hash) + sizeof(uint64_t))
+  {
+    crypto::hash top_hash;
+    uint64_t n_spent_keys;
+    memcpy(&top_hash, data.data(), sizeof(top_hash));
+    memcpy(&n_spent_keys, data.data() + sizeof(top_hash), sizeof(n_spent_keys));
+    std::unique_ptr<key_image_filter> filter(new key_image_filter());
+    if (top_hash == top_block_hash() && n_spent_keys == num_spent_keys()
+        && filter->deserialize(data.substr(sizeof(top_hash) + sizeof(n_spent_keys))))
+    {
+      MINFO("Loaded spent key image filter (" << n_spent_keys << " key images)");
+      boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+      m_key_image_filter = std::move(filter);
+      m_key_image_filter_removals.clear();
+      m_key_image_filter_rebuild = false;
+      return;
+    }
+    MINFO("Saved spent key image filter is stale, rebuilding it");
+  }
+  rebuild_key_image_filter();
+}
+
+std::unique_ptr<key_image_filter> BlockchainLMDB::build_key_image_filter() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // leave room for twice as many, so it is not rebuilt again too soon
+  const uint64_t n_spent_keys = num_spent_keys();
+  std::unique_ptr<key_image_filter> filter(new key_image_filter(2 * n_spent_keys));
+  bool full = false;
+  for_all_key_images([&](const crypto::key_image &k_image) {
+    full = !filter->insert(k_image);
+    return !full;
+  });
+  if (full)
+  {
+    MERROR("Failed to build spent key image filter, key images will be looked up in the db");
+    return nullptr;
+  }
+  MINFO("Built spent key image filter (" << n_spent_keys << " key images)");
+  return filter;
+}
+
+void BlockchainLMDB::rebuild_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  join_key_image_filter_builder();
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+    m_key_image_filter.reset();
+    m_key_image_filter_removals.clear();
+    m_key_image_filter_rebuild = false;
+  }
+
+  std::unique_ptr<key_image_filter> filter = build_key_image_filter();
+  boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+  m_key_image_filter = std::move(filter);
+}
+
+void BlockchainLMDB::start_key_image_filter_rebuild()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  join_key_image_filter_builder();
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+    m_key_image_filter.reset();
+    m_key_image_filter_removals.clear();
+    m_key_image_filter_rebuild = false;
+    m_key_image_filter_building = true;
+    m_key_image_filter_added_since.clear();
+    m_key_image_filter_removed_since.clear();
+  }
+
+  // the writer is between txns: once the builder has its snapshot, every
+  // later change to the spent keys is recorded for it to replay
+  boost::promise<void> snapshot_taken;
+  boost::unique_future<void> snapshot = snapshot_taken.get_future();
+  m_key_image_filter_builder = boost::thread([this, &snapshot_taken]() { key_image_filter_builder(snapshot_taken); });
+  snapshot.wait();
+}
+
+void BlockchainLMDB::key_image_filter_builder(boost::promise<void> &snapshot_taken)
+{
+  std::unique_ptr<key_image_filter> filter;
+  bool started = false;
+  try
+  {
+    db_rtxn_guard rtxn_guard(this);
+    snapshot_taken.set_value();
+    started = true;
+    filter = build_key_image_filter();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to build spent key image filter: " << e.what());
+    filter.reset();
+  }
+  if (!started)
+    snapshot_taken.set_value();
+
+  boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+  // key images removed since were either in the snapshot or added since
+  for (const crypto::key_image &k_image: m_key_image_filter_added_since)
+  {
+    if (filter && !filter->insert(k_image))
+    {
+      MERROR("Failed to build spent key image filter, key images will be looked up in the db");
+      filter.reset();
+    }
+  }
+  if (filter)
+    for (const crypto::key_image &k_image: m_key_image_filter_removed_since)
+      filter->remove(k_image);
+  m_key_image_filter = std::move(filter);
+  m_key_image_filter_building = false;
+  m_key_image_filter_added_since.clear();
+  m_key_image_filter_removed_since.clear();
+}
+
+void BlockchainLMDB::join_key_image_filter_builder()
+{
+  if (m_key_image_filter_builder.joinable())
+    m_key_image_filter_builder.join();
+}
+
+void BlockchainLMDB::store_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (is_read_only())
+    return;
+
+  std::string data;
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+    if (!m_key_image_filter)
+      return;
+    data = m_key_image_filter->serialize();
+  }
+  const crypto::hash top_hash = top_block_hash();
+  const uint64_t n_spent_keys = num_spent_keys();
+  data.insert(0, (const char*)&n_spent_keys, sizeof(n_spent_keys));
+  data.insert(0, (const char*)&top_hash, sizeof(top_hash));
+  if (!epee::file_io_utils::save_string_to_file(get_key_image_filter_file(), data))
+    MWARNING("Failed to save spent key image filter, it will be rebuilt on next start");
+}
+
+void BlockchainLMDB::commit_key_image_filter()
+{
+  if (m_key_image_filter_rebuild)
+  {
+    start_key_image_filter_rebuild();
+    return;
+  }
+  if (m_key_image_filter_removals.empty())
+    return;
+  boost::unique_lock<boost::shared_mutex> lock(m_key_image_filter_mutex);
+  if (m_key_image_filter)
+    for (const crypto::key_image &k_image: m_key_image_filter_removals)
+      m_key_image_filter->remove(k_image);
+  else if (m_key_image_filter_building)
+    m_key_image_filter_removed_since.insert(m_key_image_filter_removed_since.end(), m_key_image_filter_removals.begin(), m_key_image_filter_removals.end());
+  m_key_image_filter_removals.clear();
+}
+
+void BlockchainLMDB::abort_key_image_filter()
+{
+  // the key images are still in the db, keep them in the filter
+  m_key_image_filter_removals.clear();
+}
+
+bool BlockchainLMDB::get_cached_output(MDB_txn *txn, uint64_t index, output_data_t &data) const
+{
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    if (m_output_cache_dirty)
+      return false;
+  }
+  else if (mdb_txn_id(txn) < m_output_cache_min_txnid)
+    return false;
+  return m_output_cache.get(index, data);
+}
+
+void BlockchainLMDB::cache_output(MDB_txn *txn, uint64_t index, const output_data_t &data) const
+{
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    // outputs added by this txn are not committed yet
+    if (!m_output_cache_dirty && data.height < m_output_cache_height)
+      m_output_cache.put(index, data, m_output_cache.epoch());
+    return;
+  }
+  if (m_tinfo.get() && mdb_txn_id(txn) >= m_output_cache_min_txnid)
+    m_output_cache.put(index, data, m_tinfo->m_ti_output_cache_epoch);
+}
+
+void BlockchainLMDB::start_output_cache_write()
+{
+  m_output_cache_dirty = false;
+  m_output_cache_height = height();
+}
+
+void BlockchainLMDB::prepare_output_cache_commit()
+{
+  // readers may have put back the rct distribution of blocks removed by this
+  // txn since, so it is cut again, and only snapshots from this txn on may
+  // extend it, before anyone can see the txn
+  if (m_rct_distribution_removed_height != std::numeric_limits<uint64_t>::max())
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_rct_distribution_mutex);
+    if (m_rct_distribution.size() > m_rct_distribution_removed_height)
+      m_rct_distribution.resize(m_rct_distribution_removed_height);
+    m_rct_distribution_min_txnid = mdb_txn_id(*m_write_txn);
+  }
+
+  // same for outputs removed by this txn: older snapshots may have cached
+  // them again since they were invalidated
+  if (m_output_cache_dirty)
+  {
+    m_output_cache_min_txnid = mdb_txn_id(*m_write_txn);
+    m_output_cache.invalidate();
+  }
+}
+
+void BlockchainLMDB::end_output_cache_write()
+{
+  m_output_cache_dirty = false;
+  m_rct_distribution_removed_height = std::numeric_limits<uint64_t>::max();
+}
+
+void BlockchainLMDB::get_output_cache_stats(uint64_t &hits, uint64_t &misses) const
+{
+  hits = m_output_cache.hits();
+  misses = m_output_cache.misses();
+}
+
 bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3545,7 +4110,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
       throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
     transaction tx;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    append_tx_blob(v, bd);
     if (pruned)
     {
       if (!parse_and_validate_tx_base_from_blob(bd, tx))
@@ -3556,7 +4121,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
       ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
       if (ret)
         throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      append_tx_blob(v, bd);
       if (!parse_and_validate_tx_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
@@ -3662,6 +4227,7 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
 
   m_writer = boost::this_thread::get_id();
   check_and_resize_for_batch(batch_num_blocks, batch_bytes);
+  train_blob_dictionary();
 
   m_write_batch_txn = new mdb_txn_safe();
 
@@ -3685,6 +4251,7 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
       mdb_txn_reset(m_tinfo->m_ti_rtxn);
     memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
   }
+  start_output_cache_write();
 
   LOG_PRINT_L3("batch transaction: begin");
   return true;
@@ -3705,16 +4272,24 @@ void BlockchainLMDB::batch_commit()
   check_open();
 
   LOG_PRINT_L3("batch transaction: committing...");
+  TIME_MEASURE_NS_START(commit_time);
+  wait_for_flush();
+  prepare_output_cache_commit();
   TIME_MEASURE_START(time1);
   m_write_txn->commit();
   TIME_MEASURE_FINISH(time1);
   time_commit1 += time1;
+  TIME_MEASURE_NS_FINISH(commit_time);
+  m_commit_latency_us = commit_time / 1000;
+  queue_flush();
   LOG_PRINT_L3("batch transaction: committed");
 
   m_write_txn = nullptr;
   delete m_write_batch_txn;
   m_write_batch_txn = nullptr;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  end_output_cache_write();
+  commit_key_image_filter();
 }
 
 void BlockchainLMDB::cleanup_batch()
@@ -3740,19 +4315,29 @@ void BlockchainLMDB::batch_stop()
     throw1(DB_ERROR("batch transaction owned by other thread"));
   check_open();
   LOG_PRINT_L3("batch transaction: committing...");
-  TIME_MEASURE_START(time1);
+  TIME_MEASURE_NS_START(commit_time);
   try
   {
+    wait_for_flush();
+    prepare_output_cache_commit();
+    TIME_MEASURE_START(time1);
     m_write_txn->commit();
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
+    TIME_MEASURE_NS_FINISH(commit_time);
+    m_commit_latency_us = commit_time / 1000;
     cleanup_batch();
+    queue_flush();
   }
   catch (const std::exception& e)
   {
     cleanup_batch();
+    end_output_cache_write();
+    abort_key_image_filter();
     throw;
   }
+  end_output_cache_write();
+  commit_key_image_filter();
   LOG_PRINT_L3("batch transaction: end");
 }
 
@@ -3776,6 +4361,8 @@ void BlockchainLMDB::batch_abort()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  end_output_cache_write();
+  abort_key_image_filter();
   LOG_PRINT_L3("batch transaction: aborted");
 }
 
@@ -3809,11 +4396,13 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     m_tinfo.reset(tinfo);
     memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
     memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
+    tinfo->m_ti_output_cache_epoch = m_output_cache.epoch(); // before the snapshot is taken
     if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
     ret = true;
   } else if (!tinfo->m_ti_rflags.m_rf_txn)
   {
+    tinfo->m_ti_output_cache_epoch = m_output_cache.epoch(); // before the snapshot is taken
     if (auto mdb_res = lmdb_txn_renew(tinfo->m_ti_rtxn))
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
     ret = true;
@@ -3871,6 +4460,7 @@ void BlockchainLMDB::block_wtxn_start()
         mdb_txn_reset(m_tinfo->m_ti_rtxn);
       memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
     }
+    start_output_cache_write();
   } else if (m_writer != boost::this_thread::get_id())
     throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when batch txn already exists in ")+__FUNCTION__).c_str()));
 }
@@ -3885,14 +4475,22 @@ void BlockchainLMDB::block_wtxn_stop()
   {
     if (! m_batch_active)
 	{
+      TIME_MEASURE_NS_START(commit_time);
+      wait_for_flush();
+      prepare_output_cache_commit();
       TIME_MEASURE_START(time1);
       m_write_txn->commit();
       TIME_MEASURE_FINISH(time1);
       time_commit1 += time1;
+      TIME_MEASURE_NS_FINISH(commit_time);
+      m_commit_latency_us = commit_time / 1000;
+      queue_flush();
 
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+      end_output_cache_write();
+      commit_key_image_filter();
 	}
   }
 }
@@ -3910,6 +4508,8 @@ void BlockchainLMDB::block_wtxn_abort()
     delete m_write_txn;
     m_write_txn = nullptr;
     memset(&m_wcursors, 0, sizeof(m_wcursors));
+    end_output_cache_write();
+    abort_key_image_filter();
   }
 }
 
@@ -4012,6 +4612,13 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
   for (size_t i = 0; i < offsets.size(); ++i)
   {
     const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[i];
+    if (amount == 0)
+    {
+      outputs.resize(outputs.size() + 1);
+      if (get_cached_output(m_txn, offsets[i], outputs.back()))
+        continue;
+      outputs.pop_back();
+    }
 	  MDB_val_set(k, amount);
 	  MDB_val_set(v, offsets[i]);
 
@@ -4032,6 +4639,7 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
     {
       const outkey *okp = (const outkey *)v.mv_data;
       outputs.push_back(okp->data);
+      cache_output(m_txn, offsets[i], okp->data);
     }
     else
     {
@@ -30,9 +30,15 @@
 #include <atomic>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/blob_codec.h"
+#include "blockchain_db/key_image_filter.h"
+#include "blockchain_db/output_cache.h"
+#include "blockchain_db/write_behind.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
 #include <boost/thread/tss.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/future.hpp>
 
 #include <lmdb.h>
 
@@ -122,6 +128,7 @@ typedef struct mdb_threadinfo
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  uint64_t m_ti_output_cache_epoch;	// output cache epoch when the read txn started
 
   ~mdb_threadinfo();
 } mdb_threadinfo;
@@ -218,6 +225,8 @@ public:
 
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
 
+  virtual bool get_rct_output_distribution(uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const;
+
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
 
   virtual uint64_t get_top_block_timestamp() const;
@@ -401,6 +410,31 @@ private:
 
   uint64_t num_outputs() const;
 
+  // the spent key image filter is loaded or rebuilt on open and saved on close;
+  // removals only reach it once the txn making them is committed. When it has
+  // to be rebuilt after a commit, that is done on another thread, off its own
+  // snapshot, and changes made since are replayed before it is used again
+  std::string get_key_image_filter_file() const;
+  uint64_t num_spent_keys() const;
+  void load_key_image_filter();
+  std::unique_ptr<key_image_filter> build_key_image_filter() const;
+  void rebuild_key_image_filter();
+  void start_key_image_filter_rebuild();
+  void key_image_filter_builder(boost::promise<void> &snapshot_taken);
+  void join_key_image_filter_builder();
+  void store_key_image_filter();
+  void commit_key_image_filter();
+  void abort_key_image_filter();
+
+  // the output cache is bypassed by a writer which removed outputs, and only
+  // gets outputs the writer reads if they were committed before its txn
+  bool get_cached_output(MDB_txn *txn, uint64_t index, output_data_t &data) const;
+  void cache_output(MDB_txn *txn, uint64_t index, const output_data_t &data) const;
+  void start_output_cache_write();
+  void prepare_output_cache_commit();
+  void end_output_cache_write();
+  void truncate_rct_distribution(uint64_t height);
+
   // Hard fork
   virtual void set_hard_fork_version(uint64_t height, uint8_t version);
   virtual uint8_t get_hard_fork_version(uint64_t height) const;
@@ -415,6 +449,17 @@ private:
 
   virtual uint64_t get_database_size() const;
 
+  virtual void get_output_cache_stats(uint64_t &hits, uint64_t &misses) const;
+
+  virtual void get_commit_latency(uint64_t &commit_us, uint64_t &flush_us) const;
+
+  // write-behind: commits skip the meta page fsync, m_write_behind makes them durable
+  int flush();
+  void start_flush_thread(const int db_flags);
+  void stop_flush_thread();
+  void wait_for_flush();
+  void queue_flush();
+
   std::vector<uint64_t> get_block_info_64bit_fields(uint64_t start_height, size_t count, off_t offset) const;
 
   uint64_t get_max_block_size();
@@ -440,6 +485,11 @@ private:
 
   void cleanup_batch();
 
+  // tx blobs go through m_blob_codec when the db is compressed
+  void put_tx_blob(MDB_cursor *cursor, MDB_val *key, const char *data, size_t size, const char *what);
+  void append_tx_blob(const MDB_val &v, cryptonote::blobdata &bd) const;
+  void train_blob_dictionary();
+
 private:
   MDB_env* m_env;
 
@@ -483,6 +533,38 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  mutable boost::shared_mutex m_key_image_filter_mutex;
+  std::unique_ptr<key_image_filter> m_key_image_filter; // null while unusable
+  std::vector<crypto::key_image> m_key_image_filter_removals;
+  bool m_key_image_filter_rebuild;
+  boost::thread m_key_image_filter_builder;
+  bool m_key_image_filter_building;
+  std::vector<crypto::key_image> m_key_image_filter_added_since;
+  std::vector<crypto::key_image> m_key_image_filter_removed_since;
+
+  mutable output_cache m_output_cache;
+  bool m_output_cache_dirty;
+  uint64_t m_output_cache_height;
+  // only snapshots from the last commit which removed outputs on may use the
+  // output cache, so outputs they do not have are never seen or put back
+  std::atomic<uint64_t> m_output_cache_min_txnid;
+
+  // cumulative rct outputs per height, for committed blocks only; it is only
+  // extended by, and served to, readers whose snapshot includes the last
+  // commit which removed blocks, so stale heights are never seen
+  mutable boost::shared_mutex m_rct_distribution_mutex;
+  mutable std::vector<uint64_t> m_rct_distribution;
+  mutable uint64_t m_rct_distribution_min_txnid;
+  uint64_t m_rct_distribution_removed_height;
+
+  write_behind m_write_behind;
+  std::atomic<uint64_t> m_commit_latency_us;
+  std::atomic<uint64_t> m_flush_latency_us;
+
+  std::unique_ptr<blob_codec> m_blob_codec; // null unless the db was created compressed
+  std::vector<std::string> m_blob_dictionary_samples;
+  size_t m_blob_dictionary_sample_bytes;
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -495,6 +577,10 @@ private:
 #endif
 
   constexpr static float RESIZE_PERCENT = 0.9f;
+
+  // the dictionary is trained once from the first tx blobs written
+  constexpr static size_t BLOB_DICTIONARY_SIZE = 112640;
+  constexpr static size_t BLOB_DICTIONARY_SAMPLE_BYTES = 100 * BLOB_DICTIONARY_SIZE;
 };
 
 }  // namespace cryptonote
@@ -0,0 +1,115 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/thread/lock_guard.hpp>
+#include "output_cache.h"
+
+// approximate memory used per entry: the list node and the hash table node and bucket
+#define OUTPUT_CACHE_ENTRY_SIZE (sizeof(std::pair<uint64_t, output_data_t>) + 4 * sizeof(void*) + 3 * sizeof(void*) + sizeof(uint64_t))
+
+namespace cryptonote
+{
+//---------------------------------------------------------------
+output_cache::output_cache(size_t max_bytes):
+  m_shards(new shard[NUM_SHARDS]),
+  m_shard_capacity(max_bytes / OUTPUT_CACHE_ENTRY_SIZE / NUM_SHARDS),
+  m_epoch(0),
+  m_hits(0),
+  m_misses(0)
+{
+  for (size_t n = 0; n < NUM_SHARDS; ++n)
+    m_shards[n].entries.reserve(m_shard_capacity);
+}
+//---------------------------------------------------------------
+bool output_cache::get(uint64_t index, output_data_t &data)
+{
+  shard &s = get_shard(index);
+  {
+    boost::lock_guard<boost::mutex> lock(s.mutex);
+    const auto i = s.entries.find(index);
+    if (i != s.entries.end())
+    {
+      s.lru.splice(s.lru.begin(), s.lru, i->second);
+      data = i->second->second;
+      m_hits.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+//---------------------------------------------------------------
+void output_cache::put(uint64_t index, const output_data_t &data, uint64_t epoch)
+{
+  if (m_shard_capacity == 0)
+    return;
+  shard &s = get_shard(index);
+  boost::lock_guard<boost::mutex> lock(s.mutex);
+  // checked under the shard lock, so invalidate can't clear this shard between the check and the insertion
+  if (epoch != m_epoch.load())
+    return;
+  const auto i = s.entries.find(index);
+  if (i != s.entries.end())
+  {
+    s.lru.splice(s.lru.begin(), s.lru, i->second);
+    return;
+  }
+  if (s.entries.size() >= m_shard_capacity)
+  {
+    s.entries.erase(s.lru.back().first);
+    s.lru.pop_back();
+  }
+  s.lru.emplace_front(index, data);
+  s.entries.emplace(index, s.lru.begin());
+}
+//---------------------------------------------------------------
+void output_cache::invalidate()
+{
+  ++m_epoch;
+  for (size_t n = 0; n < NUM_SHARDS; ++n)
+  {
+    shard &s = m_shards[n];
+    boost::lock_guard<boost::mutex> lock(s.mutex);
+    s.entries.clear();
+    s.lru.clear();
+  }
+}
+//---------------------------------------------------------------
+size_t output_cache::size() const
+{
+  size_t size = 0;
+  for (size_t n = 0; n < NUM_SHARDS; ++n)
+  {
+    shard &s = m_shards[n];
+    boost::lock_guard<boost::mutex> lock(s.mutex);
+    size += s.entries.size();
+  }
+  return size;
+}
+//---------------------------------------------------------------
+}
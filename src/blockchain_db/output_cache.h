@@ -0,0 +1,100 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <boost/thread/mutex.hpp>
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief an LRU cache of rct output data, keyed by global rct output index
+   *
+   * The cache is split in shards by index, each with its own lock and LRU
+   * list, so concurrent lookups of different outputs rarely contend.
+   *
+   * Outputs never change while they exist, so the only thing to guard
+   * against is an output being removed (and its index reused) while a reader
+   * still works on a snapshot taken before that. Readers take epoch() before
+   * their snapshot and pass it to put(), which drops the value if
+   * invalidate() was called in between.
+   */
+  class output_cache
+  {
+  public:
+    /**
+     * @brief creates a cache using up to about max_bytes of memory
+     */
+    explicit output_cache(size_t max_bytes);
+
+    /**
+     * @brief looks an output up, and counts a hit or miss
+     */
+    bool get(uint64_t index, output_data_t &data);
+
+    /**
+     * @brief adds an output read from a snapshot taken at the given epoch
+     */
+    void put(uint64_t index, const output_data_t &data, uint64_t epoch);
+
+    /**
+     * @brief empties the cache, and rejects values read before this call
+     */
+    void invalidate();
+
+    uint64_t epoch() const { return m_epoch.load(); }
+    uint64_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+    size_t size() const;
+    size_t capacity() const { return m_shard_capacity * NUM_SHARDS; }
+
+  private:
+    static constexpr size_t NUM_SHARDS = 16;
+
+    struct shard
+    {
+      boost::mutex mutex;
+      std::list<std::pair<uint64_t, output_data_t>> lru; // most recent first
+      std::unordered_map<uint64_t, std::list<std::pair<uint64_t, output_data_t>>::iterator> entries;
+    };
+
+    shard &get_shard(uint64_t index) { return m_shards[index % NUM_SHARDS]; }
+
+    std::unique_ptr<shard[]> m_shards;
+    size_t m_shard_capacity;
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+  };
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "write_behind.h"
+
+namespace cryptonote
+{
+
+write_behind::write_behind(sync_t sync):
+  m_sync(std::move(sync)),
+  m_running(false),
+  m_pending(false),
+  m_stop(false),
+  m_error(0)
+{
+}
+
+write_behind::~write_behind()
+{
+  stop();
+}
+
+void write_behind::start()
+{
+  if (m_running)
+    return;
+  m_pending = false;
+  m_stop = false;
+  m_error = 0;
+  m_thread = boost::thread(&write_behind::run, this);
+  m_running = true;
+}
+
+int write_behind::stop()
+{
+  if (!m_running)
+    return 0;
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_stop = true;
+    m_cond.notify_all();
+  }
+  // any pending flush is finished before the thread exits
+  m_thread.join();
+  m_running = false;
+  const int result = m_error;
+  m_error = 0;
+  return result;
+}
+
+int write_behind::wait()
+{
+  if (!m_running)
+    return 0;
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  while (m_pending)
+    m_cond.wait(lock);
+  const int result = m_error;
+  m_error = 0;
+  return result;
+}
+
+void write_behind::queue()
+{
+  if (!m_running)
+    return;
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_pending = true;
+  m_cond.notify_all();
+}
+
+void write_behind::run()
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  while (true)
+  {
+    while (!m_pending && !m_stop)
+      m_cond.wait(lock);
+    if (!m_pending)
+      break;
+    lock.unlock();
+
+    const int result = m_sync();
+
+    lock.lock();
+    if (result && !m_error)
+      m_error = result;
+    m_pending = false;
+    m_cond.notify_all();
+  }
+}
+
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace cryptonote
+{
+  /**
+   * @brief flushes commits to disk on its own thread
+   *
+   * The writer calls wait() before each commit and queue() after it. At most
+   * one commit is therefore waiting to be flushed, and the next one only
+   * starts once it is on disk, so the last flushed state is never written
+   * over. A failed flush is handed to the next wait().
+   */
+  class write_behind
+  {
+  public:
+    /**
+     * @brief the flush itself: returns 0 on success, or an error code
+     */
+    typedef std::function<int()> sync_t;
+
+    explicit write_behind(sync_t sync);
+    ~write_behind();
+
+    write_behind(const write_behind&) = delete;
+    write_behind &operator=(const write_behind&) = delete;
+
+    void start();
+
+    /**
+     * @brief finishes any pending flush, then stops the thread
+     *
+     * @return the error of the last flush if it was not reported yet, or 0
+     */
+    int stop();
+
+    /**
+     * @brief waits for the pending flush, if any
+     *
+     * @return the error of a flush not reported yet, or 0
+     */
+    int wait();
+
+    /**
+     * @brief queues a flush of the commit just made
+     */
+    void queue();
+
+    bool running() const { return m_running; }
+
+  private:
+    void run();
+
+    const sync_t m_sync;
+    std::atomic<bool> m_running;
+    boost::thread m_thread;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_pending;
+    bool m_stop;
+    int m_error;
+  };
+}
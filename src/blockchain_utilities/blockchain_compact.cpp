@@ -0,0 +1,269 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <lmdb.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "version.h"
+
+#undef GNTL_DEFAULT_LOG_CATEGORY
+#define GNTL_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+
+namespace
+{
+
+struct table_stats
+{
+  uint64_t pages;
+  uint64_t entries;
+};
+
+struct env_stats
+{
+  uint64_t page_size;
+  uint64_t used_pages;
+  std::map<std::string, table_stats> tables;
+};
+
+void open(MDB_env *&env, const boost::filesystem::path &path, bool exclusive)
+{
+  int dbr = mdb_env_create(&env);
+  if (dbr) throw std::runtime_error("Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_env_set_maxdbs(env, 32);
+  if (dbr) throw std::runtime_error("Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
+  // read only, so a running daemon keeps its write lock and goes on serving;
+  // when the caller holds the lock file, LMDB must not touch it, as closing
+  // the env would drop that lock
+  dbr = mdb_env_open(env, path.string().c_str(), MDB_RDONLY | MDB_NOTLS | (exclusive ? MDB_NOLOCK : 0), 0664);
+  if (dbr) throw std::runtime_error("Failed to open database file '"
+      + path.string() + "': " + std::string(mdb_strerror(dbr)));
+}
+
+env_stats get_stats(MDB_env *env)
+{
+  env_stats stats;
+  MDB_envinfo mei;
+  MDB_stat mst;
+  mdb_env_info(env, &mei);
+  mdb_env_stat(env, &mst);
+  stats.page_size = mst.ms_psize;
+  stats.used_pages = mei.me_last_pgno + 1;
+
+  MDB_txn *txn;
+  int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){
+    mdb_txn_abort(txn);
+  });
+
+  // the main db holds the names of all the tables
+  MDB_dbi main_dbi;
+  dbr = mdb_dbi_open(txn, NULL, 0, &main_dbi);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  MDB_cursor *cur;
+  dbr = mdb_cursor_open(txn, main_dbi, &cur);
+  if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
+  MDB_val k, v;
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(cur, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw std::runtime_error("Failed to enumerate tables: " + std::string(mdb_strerror(ret)));
+    const std::string name((const char*)k.mv_data, k.mv_size);
+    MDB_dbi dbi;
+    if (mdb_dbi_open(txn, name.c_str(), 0, &dbi))
+      continue;
+    MDB_stat tst;
+    dbr = mdb_stat(txn, dbi, &tst);
+    if (dbr) throw std::runtime_error("Failed to stat " + name + " LMDB table: " + std::string(mdb_strerror(dbr)));
+    stats.tables[name] = {tst.ms_branch_pages + tst.ms_leaf_pages + tst.ms_overflow_pages, tst.ms_entries};
+  }
+  mdb_cursor_close(cur);
+  return stats;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<bool> arg_copy_only  = {"copy-only",  "Write the compacted copy, but do not swap it in"};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_copy_only);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "GNTL '" << GNTL_RELEASE_NAME << "' (v" << GNTL_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("gntl-blockchain-compact.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  MINFO("Starting...");
+
+  bool opt_copy_only = command_line::get_arg(vm, arg_copy_only);
+  std::string data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+  while (boost::ends_with(data_dir, "/") || boost::ends_with(data_dir, "\\"))
+    data_dir.pop_back();
+
+  const boost::filesystem::path source_path = boost::filesystem::path(data_dir) / "lmdb";
+  const boost::filesystem::path compact_path = boost::filesystem::path(data_dir) / "lmdb-compact";
+  if (!boost::filesystem::exists(source_path / "data.mdb"))
+  {
+    MERROR("No database found in " << source_path.string());
+    return 1;
+  }
+  if (boost::filesystem::exists(compact_path))
+    boost::filesystem::remove_all(compact_path);
+  if (!boost::filesystem::create_directories(compact_path))
+  {
+    MERROR("Failed to create directory: " << compact_path.string());
+    return 1;
+  }
+
+  // LMDB keeps a lock on its lock file for as long as a process has the
+  // database open, so getting a write lock on all of it proves nobody else
+  // does, and keeps any daemon from opening it until the swap is done
+  std::unique_ptr<tools::file_locker> source_lock;
+  if (!opt_copy_only)
+  {
+    source_lock.reset(new tools::file_locker((source_path / CRYPTONOTE_BLOCKCHAINDATA_LOCK_FILENAME).string()));
+    if (!source_lock->locked())
+    {
+      MERROR("The database is in use by another process, stop the daemon and run again, or use --" << arg_copy_only.name);
+      return 1;
+    }
+  }
+
+  MDB_env *env0 = NULL, *env1 = NULL;
+  open(env0, source_path, !opt_copy_only);
+  const env_stats before = get_stats(env0);
+
+  // LMDB writes the copy from a single read txn, in key order and without
+  // the free pages, so it is consistent even if a daemon keeps writing
+  MINFO("Compacting " << source_path.string() << " into " << compact_path.string() << "...");
+  int dbr = mdb_env_copy2(env0, compact_path.string().c_str(), MDB_CP_COMPACT);
+  if (dbr)
+  {
+    mdb_env_close(env0);
+    MERROR("Failed to compact database: " << mdb_strerror(dbr));
+    return 1;
+  }
+
+  open(env1, compact_path, false);
+  const env_stats after = get_stats(env1);
+  mdb_env_close(env1);
+
+  MINFO("Pages used (" << before.page_size << " bytes each):");
+  for (const auto &e: before.tables)
+  {
+    const auto i = after.tables.find(e.first);
+    const table_stats compacted = i == after.tables.end() ? table_stats{0, 0} : i->second;
+    MINFO("  " << e.first << ": " << e.second.pages << " -> " << compacted.pages);
+  }
+  MINFO("  total: " << before.used_pages << " -> " << after.used_pages);
+
+  mdb_env_close(env0);
+  if (opt_copy_only)
+  {
+    MINFO("Compacted database left in " << compact_path.string());
+    return 0;
+  }
+
+  // nothing could write to the source meanwhile, so the copy must match exactly
+  for (const auto &e: before.tables)
+  {
+    const auto i = after.tables.find(e.first);
+    if (i == after.tables.end() || i->second.entries != e.second.entries)
+    {
+      MERROR("Compacted database does not match the original, not swapping it in");
+      return 1;
+    }
+  }
+
+  // rename replaces the data file atomically, so the database is never missing,
+  // and the source lock is only released once it is done
+  MINFO("Swapping databases...");
+  std::error_code ec = tools::replace_file((compact_path / "data.mdb").string(), (source_path / "data.mdb").string());
+  if (ec)
+  {
+    MERROR("Database compacted OK, but renaming failed: " << ec.message());
+    return 1;
+  }
+  boost::filesystem::remove_all(compact_path);
+
+  MINFO("Database compacted OK, " << (before.used_pages - std::min(before.used_pages, after.used_pages)) * before.page_size / (1024 * 1024) << " MiB freed");
+  return 0;
+
+  CATCH_ENTRY("Compaction error", 1);
+}
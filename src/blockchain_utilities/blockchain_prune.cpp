@@ -233,12 +233,19 @@ static void copy_table(MDB_env *env0, MDB_env *env1, const char *table, unsigned
   mdb_dbi_close(env0, dbi0);
 }
 
-static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
+static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id, const blob_codec *codec)
 {
   MDB_val v;
   int ret = mdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
   if (ret)
     throw std::runtime_error("Failed to find transaction pruned data: " + std::string(mdb_strerror(ret)));
+  if (codec)
+  {
+    cryptonote::blobdata bd;
+    if (!codec->decompress(v.mv_data, v.mv_size, bd) || bd.empty())
+      throw std::runtime_error("Invalid transaction pruned data");
+    return cryptonote::is_v1_tx(bd);
+  }
   if (v.mv_size == 0)
     throw std::runtime_error("Invalid transaction pruned data");
   return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
@@ -246,7 +253,7 @@ static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
 
 static void prune(MDB_env *env0, MDB_env *env1)
 {
-  MDB_dbi dbi0_blocks, dbi0_txs_pruned, dbi0_txs_prunable, dbi0_tx_indices, dbi1_txs_prunable, dbi1_txs_prunable_tip, dbi1_properties;
+  MDB_dbi dbi0_blocks, dbi0_txs_pruned, dbi0_txs_prunable, dbi0_tx_indices, dbi0_properties, dbi1_txs_prunable, dbi1_txs_prunable_tip, dbi1_properties;
   MDB_txn *txn0, *txn1;
   MDB_cursor *cur0_txs_pruned, *cur0_txs_prunable, *cur0_tx_indices, *cur1_txs_prunable, *cur1_txs_prunable_tip;
   bool tx_active0 = false, tx_active1 = false;
@@ -284,6 +291,21 @@ static void prune(MDB_env *env0, MDB_env *env1)
   dbr = mdb_cursor_open(txn0, dbi0_tx_indices, &cur0_tx_indices);
   if (dbr) throw std::runtime_error("Failed to create LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
+  // compressed tx blobs are copied as they are, but need decoding to check their version
+  std::unique_ptr<blob_codec> codec;
+  dbr = mdb_dbi_open(txn0, "properties", 0, &dbi0_properties);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  MDB_val kc = {strlen("blob_compression") + 1, (void*)"blob_compression"}, vc;
+  if (mdb_get(txn0, dbi0_properties, &kc, &vc) == 0)
+  {
+    if (!blob_codec::available())
+      throw std::runtime_error("Database is compressed, but this build has no zstd support");
+    codec.reset(new blob_codec());
+    MDB_val kd = {strlen("blob_dictionary") + 1, (void*)"blob_dictionary"};
+    if (mdb_get(txn0, dbi0_properties, &kd, &vc) == 0)
+      codec->set_dictionary(std::string((const char*)vc.mv_data, vc.mv_size));
+  }
+
   dbr = mdb_dbi_open(txn1, "txs_prunable", MDB_INTEGERKEY, &dbi1_txs_prunable);
   if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
   mdb_set_compare(txn1, dbi1_txs_prunable, BlockchainLMDB::compare_uint64);
@@ -343,7 +365,7 @@ static void prune(MDB_env *env0, MDB_env *env1)
       if (dbr) throw std::runtime_error("Failed to write prunable tx tip data: " + std::string(mdb_strerror(dbr)));
       bytes += kk.mv_size + vv.mv_size;
     }
-    if (tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) || is_v1_tx(cur0_txs_pruned, &kk))
+    if (tools::has_unpruned_block(block_height, blockchain_height, pruning_seed) || is_v1_tx(cur0_txs_pruned, &kk, codec.get()))
     {
       MDB_val vv;
       dbr = mdb_cursor_get(cur0_txs_prunable, &kk, &vv, MDB_SET);
@@ -34,6 +34,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
@@ -244,6 +245,73 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const std::vector<public_key> &keys, const secret_key &sec, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    const size_t n = keys.size();
+    std::vector<ge_p2> points(n);
+    std::unique_ptr<fe[]> scratch(new fe[n]);
+    ge_p3 point;
+    ge_p1p1 point2;
+    size_t n_valid = 0;
+    assert(sc_check(&sec) == 0);
+    derivations.resize(n);
+    valid.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      valid[i] = ge_frombytes_vartime(&point, &keys[i]) == 0;
+      if (!valid[i]) {
+        continue;
+      }
+      ge_scalarmult(&points[n_valid], &unwrap(sec), &point);
+      ge_mul8(&point2, &points[n_valid]);
+      ge_p1p1_to_p2(&points[n_valid], &point2);
+      ++n_valid;
+    }
+    if (n_valid == n) {
+      ge_tobytes_batch(reinterpret_cast<unsigned char*>(derivations.data()), points.data(), scratch.get(), n);
+      return true;
+    }
+    std::vector<key_derivation> encoded(n_valid);
+    ge_tobytes_batch(reinterpret_cast<unsigned char*>(encoded.data()), points.data(), scratch.get(), n_valid);
+    for (size_t i = 0, j = 0; i < n; ++i)
+      derivations[i] = valid[i] ? encoded[j++] : key_derivation{};
+    return false;
+  }
+
+  bool crypto_ops::derive_subaddress_public_keys(const std::vector<public_key> &out_keys, const std::vector<key_derivation> &derivations, const std::vector<std::size_t> &output_indices, std::vector<public_key> &results, std::vector<bool> &valid) {
+    const size_t n = out_keys.size();
+    std::vector<ge_p2> points(n);
+    std::unique_ptr<fe[]> scratch(new fe[n]);
+    ec_scalar scalar;
+    ge_p3 point1;
+    ge_p3 point2;
+    ge_cached point3;
+    ge_p1p1 point4;
+    size_t n_valid = 0;
+    assert(derivations.size() == n && output_indices.size() == n);
+    results.resize(n);
+    valid.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      valid[i] = ge_frombytes_vartime(&point1, &out_keys[i]) == 0;
+      if (!valid[i]) {
+        continue;
+      }
+      derivation_to_scalar(derivations[i], output_indices[i], scalar);
+      ge_scalarmult_base(&point2, &scalar);
+      ge_p3_to_cached(&point3, &point2);
+      ge_sub(&point4, &point1, &point3);
+      ge_p1p1_to_p2(&points[n_valid], &point4);
+      ++n_valid;
+    }
+    if (n_valid == n) {
+      ge_tobytes_batch(reinterpret_cast<unsigned char*>(results.data()), points.data(), scratch.get(), n);
+      return true;
+    }
+    std::vector<public_key> encoded(n_valid);
+    ge_tobytes_batch(reinterpret_cast<unsigned char*>(encoded.data()), points.data(), scratch.get(), n_valid);
+    for (size_t i = 0, j = 0; i < n; ++i)
+      results[i] = valid[i] ? encoded[j++] : public_key{};
+    return false;
+  }
+
   struct s_comm {
     hash h;
     ec_point key;
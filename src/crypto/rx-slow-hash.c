@@ -35,6 +35,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#endif
 
 #include "randomx.h"
 #include "c_threads.h"
@@ -43,6 +47,13 @@
 
 #define RX_LOGCAT	"randomx"
 
+#if defined(__linux__)
+#define RX_NUMA
+#endif
+#define RX_MAX_NODES	8
+#define RX_MAX_CPUS	1024
+#define RX_DATASET_ITEM_SIZE	64
+
 #if defined(_MSC_VER)
 #define THREADV __declspec(thread)
 #else
@@ -61,10 +72,36 @@ static CTHR_MUTEX_TYPE rx_dataset_mutex = CTHR_MUTEX_INIT;
 
 static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0},{CTHR_MUTEX_INIT,{0},0,0}};
 
-static randomx_dataset *rx_dataset;
+/* one dataset per NUMA node when GNTL_RANDOMX_NUMA is set, otherwise just the first */
+static randomx_dataset *rx_dataset[RX_MAX_NODES];
 static int rx_dataset_nomem;
-static uint64_t rx_dataset_height;
+static uint64_t rx_dataset_height[RX_MAX_NODES];
+static int rx_numa_nodes = -1;
+static int rx_dataset_threads = 1;
 static THREADV randomx_vm *rx_vm = NULL;
+static THREADV int rx_vm_node = 0;
+static THREADV randomx_dataset *rx_vm_dataset = NULL;
+
+/* while mining, the dataset for the next seed is built in the background into
+ * a second buffer per node, and swapped in by the first miner hashing with it */
+static randomx_dataset *rx_dataset_next[RX_MAX_NODES];
+static uint64_t rx_dataset_next_height[RX_MAX_NODES];
+static int rx_dataset_building = -1;
+
+/* light mode VMs are shared by all verifying threads rather than kept per
+ * thread, so a new thread does not pay for creating one */
+typedef struct rx_pooled_vm {
+  randomx_vm *pv_vm;
+  struct rx_pooled_vm *pv_next;
+} rx_pooled_vm;
+
+static CTHR_MUTEX_TYPE rx_pool_mutex = CTHR_MUTEX_INIT;
+static rx_pooled_vm *rx_pool = NULL;
+
+#ifdef RX_NUMA
+static unsigned char rx_cpu_node[RX_MAX_CPUS];
+static cpu_set_t rx_node_cpus[RX_MAX_NODES];
+#endif
 
 static void local_abort(const char *msg)
 {
@@ -117,12 +154,16 @@ static inline int enabled_flags(void) {
 #define SEEDHASH_EPOCH_LAG 64
 
 void rx_reorg(const uint64_t split_height) {
-  int i;
+  int i, n;
   CTHR_MUTEX_LOCK(rx_mutex);
   for (i=0; i<2; i++) {
     if (split_height <= rx_s[i].rs_height) {
-      if (rx_s[i].rs_height == rx_dataset_height)
-        rx_dataset_height = 1;
+      for (n=0; n<RX_MAX_NODES; n++) {
+        if (rx_s[i].rs_height == rx_dataset_height[n])
+          rx_dataset_height[n] = 1;
+        if (rx_s[i].rs_height == rx_dataset_next_height[n])
+          rx_dataset_next_height[n] = 1;
+      }
       rx_s[i].rs_height = 1;	/* set to an invalid seed height */
     }
   }
@@ -140,55 +181,284 @@ void rx_seedheights(const uint64_t height, uint64_t *seedheight, uint64_t *nexth
   *nextheight = rx_seedheight(height + SEEDHASH_EPOCH_LAG);
 }
 
+/* must be called with rx_dataset_mutex held */
+static int rx_get_numa_nodes(void) {
+  if (rx_numa_nodes != -1)
+    return rx_numa_nodes;
+  rx_numa_nodes = 1;
+#ifdef RX_NUMA
+  const char *env = getenv("GNTL_RANDOMX_NUMA");
+  if (!env || !strcmp(env, "0"))
+    return rx_numa_nodes;
+  int n;
+  for (n=0; n<RX_MAX_NODES; n++) {
+    char path[64], buf[1024];
+    FILE *f;
+    char *p = buf, *end;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+    f = fopen(path, "r");
+    if (f == NULL)
+      break;
+    if (fgets(buf, sizeof(buf), f) == NULL) {
+      fclose(f);
+      break;
+    }
+    fclose(f);
+    /* ranges of cpus, like 0-7,16-23 */
+    CPU_ZERO(&rx_node_cpus[n]);
+    while (*p && *p != '\n') {
+      long lo = strtol(p, &end, 10), hi = lo, cpu;
+      if (end == p)
+        break;
+      if (*end == '-') {
+        p = end + 1;
+        hi = strtol(p, &end, 10);
+      }
+      for (cpu = lo; cpu <= hi && cpu < RX_MAX_CPUS; cpu++) {
+        rx_cpu_node[cpu] = n;
+        CPU_SET(cpu, &rx_node_cpus[n]);
+      }
+      p = *end == ',' ? end + 1 : end;
+    }
+  }
+  if (n > 1) {
+    rx_numa_nodes = n;
+    minfo(RX_LOGCAT, "Using one RandomX dataset per NUMA node, %d nodes", n);
+  }
+#endif
+  return rx_numa_nodes;
+}
+
+static int rx_current_node(void) {
+#ifdef RX_NUMA
+  if (rx_numa_nodes > 1) {
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && cpu < RX_MAX_CPUS)
+      return rx_cpu_node[cpu];
+  }
+#endif
+  return 0;
+}
+
+static void rx_bind_node(const int node) {
+#ifdef RX_NUMA
+  if (node >= 0 && sched_setaffinity(0, sizeof(cpu_set_t), &rx_node_cpus[node]))
+    mdebug(RX_LOGCAT, "Couldn't bind RandomX dataset thread to NUMA node %d", node);
+#endif
+}
+
+static void rx_advise_huge_pages(void *ptr, const size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t start = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+  const uintptr_t end = ((uintptr_t)ptr + size) & ~(page - 1);
+  if (end > start && madvise((void*)start, end - start, MADV_HUGEPAGE))
+    mdebug(RX_LOGCAT, "Couldn't use transparent huge pages for RandomX dataset");
+#endif
+}
+
+static randomx_dataset *rx_alloc_dataset(void) {
+  randomx_dataset *dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+  if (dataset == NULL) {
+    mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
+    dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+    /* before anything touches it, so the kernel can back it with huge pages */
+    if (dataset != NULL)
+      rx_advise_huge_pages(randomx_get_dataset_memory(dataset), randomx_dataset_item_count() * RX_DATASET_ITEM_SIZE);
+  }
+  return dataset;
+}
+
 typedef struct seedinfo {
   randomx_cache *si_cache;
+  randomx_dataset *si_dataset;
   unsigned long si_start;
   unsigned long si_count;
+  int si_node;
 } seedinfo;
 
 static CTHR_THREAD_RTYPE rx_seedthread(void *arg) {
   seedinfo *si = arg;
-  randomx_init_dataset(rx_dataset, si->si_cache, si->si_start, si->si_count);
+  /* pages end up on the node of the thread which first touches them */
+  rx_bind_node(si->si_node);
+  randomx_init_dataset(si->si_dataset, si->si_cache, si->si_start, si->si_count);
   CTHR_THREAD_RETURN;
 }
 
-static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight) {
-  if (miners > 1) {
-    unsigned long delta = randomx_dataset_item_count() / miners;
+static void rx_initdata(randomx_dataset *dataset, randomx_cache *rs_cache, const int miners, const int node) {
+  /* with several nodes, every slice is done by a thread bound to the node,
+   * so the caller's own affinity is left alone */
+  const int bind = rx_numa_nodes > 1 ? node : -1;
+  if (miners > 1 || bind >= 0) {
+    const int threads = miners > 1 ? miners : 1;
+    const int first = bind >= 0 ? 0 : 1;
+    unsigned long delta = randomx_dataset_item_count() / threads;
     unsigned long start = 0;
     int i;
     seedinfo *si;
     CTHR_THREAD_TYPE *st;
-    si = malloc(miners * sizeof(seedinfo));
+    si = malloc(threads * sizeof(seedinfo));
     if (si == NULL)
       local_abort("Couldn't allocate RandomX mining threadinfo");
-    st = malloc(miners * sizeof(CTHR_THREAD_TYPE));
+    st = malloc(threads * sizeof(CTHR_THREAD_TYPE));
     if (st == NULL) {
       free(si);
       local_abort("Couldn't allocate RandomX mining threadlist");
     }
-    for (i=0; i<miners-1; i++) {
+    for (i=0; i<threads-1; i++) {
       si[i].si_cache = rs_cache;
+      si[i].si_dataset = dataset;
       si[i].si_start = start;
       si[i].si_count = delta;
+      si[i].si_node = bind;
       start += delta;
     }
     si[i].si_cache = rs_cache;
+    si[i].si_dataset = dataset;
     si[i].si_start = start;
     si[i].si_count = randomx_dataset_item_count() - start;
-    for (i=1; i<miners; i++) {
+    si[i].si_node = bind;
+    for (i=first; i<threads; i++) {
       CTHR_THREAD_CREATE(st[i], rx_seedthread, &si[i]);
     }
-    randomx_init_dataset(rx_dataset, rs_cache, 0, si[0].si_count);
-    for (i=1; i<miners; i++) {
+    if (first)
+      randomx_init_dataset(dataset, rs_cache, 0, si[0].si_count);
+    for (i=first; i<threads; i++) {
       CTHR_THREAD_JOIN(st[i]);
     }
     free(st);
     free(si);
   } else {
-    randomx_init_dataset(rx_dataset, rs_cache, 0, randomx_dataset_item_count());
+    randomx_init_dataset(dataset, rs_cache, 0, randomx_dataset_item_count());
+  }
+}
+
+static randomx_cache *rx_alloc_cache(const randomx_flags flags) {
+  randomx_cache *cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+  if (cache == NULL) {
+    mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX cache");
+    cache = randomx_alloc_cache(flags);
+  }
+  if (cache == NULL)
+    local_abort("Couldn't allocate RandomX cache");
+  return cache;
+}
+
+/* must be called with rs_mutex held */
+static void rx_init_seed(rx_state *rx_sp, const uint64_t seedheight, const char *seedhash, const randomx_flags flags) {
+  randomx_cache *cache = rx_sp->rs_cache;
+  if (cache == NULL)
+    cache = rx_alloc_cache(flags);
+  if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, HASH_SIZE)) {
+    randomx_init_cache(cache, seedhash, HASH_SIZE);
+    rx_sp->rs_cache = cache;
+    rx_sp->rs_height = seedheight;
+    memcpy(rx_sp->rs_hash, seedhash, HASH_SIZE);
+  }
+}
+
+static randomx_vm *rx_create_light_vm(randomx_cache *cache) {
+  randomx_flags flags = enabled_flags() & ~disabled_flags();
+  randomx_vm *vm;
+  if (flags & RANDOMX_FLAG_JIT)
+    flags |= RANDOMX_FLAG_SECURE & ~disabled_flags();
+  vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, cache, NULL);
+  if (vm == NULL) {
+    mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
+    vm = randomx_create_vm(flags, cache, NULL);
+  }
+  if (vm == NULL)
+    vm = randomx_create_vm(RANDOMX_FLAG_DEFAULT, cache, NULL);
+  if (vm == NULL)
+    local_abort("Couldn't allocate RandomX VM");
+  return vm;
+}
+
+static rx_pooled_vm *rx_acquire_vm(randomx_cache *cache) {
+  rx_pooled_vm *pv;
+  CTHR_MUTEX_LOCK(rx_pool_mutex);
+  pv = rx_pool;
+  if (pv != NULL)
+    rx_pool = pv->pv_next;
+  CTHR_MUTEX_UNLOCK(rx_pool_mutex);
+  if (pv == NULL) {
+    pv = malloc(sizeof(rx_pooled_vm));
+    if (pv == NULL)
+      local_abort("Couldn't allocate RandomX VM pool entry");
+    pv->pv_vm = rx_create_light_vm(cache);
+  } else {
+    /* this is a no-op if the cache hasn't changed */
+    randomx_vm_set_cache(pv->pv_vm, cache);
   }
-  rx_dataset_height = seedheight;
+  return pv;
+}
+
+static void rx_release_vm(rx_pooled_vm *pv) {
+  CTHR_MUTEX_LOCK(rx_pool_mutex);
+  pv->pv_next = rx_pool;
+  rx_pool = pv;
+  CTHR_MUTEX_UNLOCK(rx_pool_mutex);
+}
+
+void rx_prebuild_datasets(const uint64_t seedheight, const char *seedhash) {
+  randomx_cache *cache = NULL;
+  int n;
+  for (n=0; n<RX_MAX_NODES; n++) {
+    randomx_dataset *dataset;
+    int threads;
+    CTHR_MUTEX_LOCK(rx_dataset_mutex);
+    if (rx_dataset[n] == NULL || rx_dataset_building != -1 || rx_dataset_height[n] == seedheight ||
+      (rx_dataset_next[n] != NULL && rx_dataset_next_height[n] == seedheight)) {
+      CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+      continue;
+    }
+    if (rx_dataset_next[n] == NULL) {
+      rx_dataset_next[n] = rx_alloc_dataset();
+      if (rx_dataset_next[n] == NULL) {
+        CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+        mwarning(RX_LOGCAT, "Couldn't allocate RandomX dataset for next seed, it will be built at the switch");
+        break;
+      }
+    }
+    /* nobody hashes with the spare buffer, and it can't be swapped in until it's done */
+    dataset = rx_dataset_next[n];
+    rx_dataset_next_height[n] = 1;
+    rx_dataset_building = n;
+    threads = rx_dataset_threads;
+    CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+
+    /* a private cache, so verification does not wait on the slot while this runs */
+    if (cache == NULL) {
+      cache = rx_alloc_cache(enabled_flags() & ~disabled_flags());
+      randomx_init_cache(cache, seedhash, HASH_SIZE);
+    }
+    minfo(RX_LOGCAT, "Building RandomX dataset for seed height %llu", (unsigned long long)seedheight);
+    rx_initdata(dataset, cache, threads, rx_numa_nodes > 1 ? n : -1);
+
+    CTHR_MUTEX_LOCK(rx_dataset_mutex);
+    rx_dataset_building = -1;
+    if (rx_dataset[n] == NULL) {
+      /* mining stopped meanwhile */
+      rx_dataset_next[n] = NULL;
+      randomx_release_dataset(dataset);
+    } else {
+      rx_dataset_next_height[n] = seedheight;
+    }
+    CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+  }
+  if (cache != NULL)
+    randomx_release_cache(cache);
+}
+
+void rx_prewarm_seed(const uint64_t seedheight, const char *seedhash) {
+  /* the slot a mainchain block hashed with this seed would use */
+  rx_state *rx_sp = &rx_s[(seedheight & SEEDHASH_EPOCH_BLOCKS) != 0];
+  CTHR_MUTEX_LOCK(rx_mutex);
+  CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+  rx_init_seed(rx_sp, seedheight, seedhash, enabled_flags() & ~disabled_flags());
+  rx_release_vm(rx_acquire_vm(rx_sp->rs_cache));
+  CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
 }
 
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
@@ -220,78 +490,85 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
   CTHR_MUTEX_UNLOCK(rx_mutex);
 
+  rx_init_seed(rx_sp, seedheight, seedhash, flags);
   cache = rx_sp->rs_cache;
-  if (cache == NULL) {
-    if (cache == NULL) {
-      cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
-      if (cache == NULL) {
-        mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX cache");
-        cache = randomx_alloc_cache(flags);
-      }
-      if (cache == NULL)
-        local_abort("Couldn't allocate RandomX cache");
-    }
+  if (miners && (disabled_flags() & RANDOMX_FLAG_FULL_MEM)) {
+    miners = 0;
   }
-  if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, HASH_SIZE)) {
-    randomx_init_cache(cache, seedhash, HASH_SIZE);
-    rx_sp->rs_cache = cache;
-    rx_sp->rs_height = seedheight;
-    memcpy(rx_sp->rs_hash, seedhash, HASH_SIZE);
+  if (!miners) {
+    rx_pooled_vm *pv = rx_acquire_vm(cache);
+    /* mainchain users can run in parallel */
+    if (!is_alt)
+      CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+    randomx_calculate_hash(pv->pv_vm, data, length, hash);
+    /* altchain slot users always get fully serialized */
+    if (is_alt)
+      CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+    rx_release_vm(pv);
+    return;
   }
   if (rx_vm == NULL) {
-    if ((flags & RANDOMX_FLAG_JIT) && !miners) {
-        flags |= RANDOMX_FLAG_SECURE & ~disabled_flags();
+    CTHR_MUTEX_LOCK(rx_dataset_mutex);
+    rx_get_numa_nodes();
+    rx_vm_node = rx_current_node();
+    rx_dataset_threads = miners;
+    if (!rx_dataset_nomem) {
+      if (rx_dataset[rx_vm_node] == NULL) {
+        rx_dataset[rx_vm_node] = rx_alloc_dataset();
+        if (rx_dataset[rx_vm_node] != NULL) {
+          rx_initdata(rx_dataset[rx_vm_node], rx_sp->rs_cache, miners, rx_numa_nodes > 1 ? rx_vm_node : -1);
+          rx_dataset_height[rx_vm_node] = seedheight;
+        }
+      }
     }
-    if (miners && (disabled_flags() & RANDOMX_FLAG_FULL_MEM)) {
+    rx_vm_dataset = rx_dataset[rx_vm_node];
+    if (rx_dataset[rx_vm_node] != NULL)
+      flags |= RANDOMX_FLAG_FULL_MEM;
+    else {
       miners = 0;
-    }
-    if (miners) {
-      CTHR_MUTEX_LOCK(rx_dataset_mutex);
       if (!rx_dataset_nomem) {
-        if (rx_dataset == NULL) {
-          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
-          if (rx_dataset == NULL) {
-            mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
-            rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
-          }
-          if (rx_dataset != NULL)
-            rx_initdata(rx_sp->rs_cache, miners, seedheight);
-        }
-      }
-      if (rx_dataset != NULL)
-        flags |= RANDOMX_FLAG_FULL_MEM;
-      else {
-        miners = 0;
-        if (!rx_dataset_nomem) {
-          rx_dataset_nomem = 1;
-          mwarning(RX_LOGCAT, "Couldn't allocate RandomX dataset for miner");
-        }
+        rx_dataset_nomem = 1;
+        mwarning(RX_LOGCAT, "Couldn't allocate RandomX dataset for miner");
       }
-      CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
+    CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset[rx_vm_node]);
     if(rx_vm == NULL) { //large pages failed
       mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
+      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset[rx_vm_node]);
     }
     if(rx_vm == NULL) {//fallback if everything fails
       flags = RANDOMX_FLAG_DEFAULT | (miners ? RANDOMX_FLAG_FULL_MEM : 0);
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
+      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset[rx_vm_node]);
     }
     if (rx_vm == NULL)
       local_abort("Couldn't allocate RandomX VM");
-  } else if (miners) {
+  } else {
+    const int node = rx_vm_node;
     CTHR_MUTEX_LOCK(rx_dataset_mutex);
-    if (rx_dataset != NULL && rx_dataset_height != seedheight)
-      rx_initdata(cache, miners, seedheight);
-    else if (rx_dataset == NULL) {
+    if (rx_dataset[node] != NULL && rx_dataset_height[node] != seedheight) {
+      if (rx_dataset_next[node] != NULL && rx_dataset_next_height[node] == seedheight) {
+        /* the old one stays as the spare, threads still hashing with it
+         * move over on their next hash */
+        randomx_dataset *rd = rx_dataset[node];
+        uint64_t height = rx_dataset_height[node];
+        rx_dataset[node] = rx_dataset_next[node];
+        rx_dataset_height[node] = seedheight;
+        rx_dataset_next[node] = rd;
+        rx_dataset_next_height[node] = height;
+      } else {
+        rx_initdata(rx_dataset[node], cache, miners, rx_numa_nodes > 1 ? node : -1);
+        rx_dataset_height[node] = seedheight;
+      }
+    }
+    if (rx_dataset[node] == NULL) {
       /* this is a no-op if the cache hasn't changed */
       randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
+    } else if (rx_vm_dataset != rx_dataset[node]) {
+      randomx_vm_set_dataset(rx_vm, rx_dataset[node]);
+      rx_vm_dataset = rx_dataset[node];
     }
     CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
-  } else {
-    /* this is a no-op if the cache hasn't changed */
-    randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
   }
   /* mainchain users can run in parallel */
   if (!is_alt)
@@ -309,15 +586,25 @@ void rx_slow_hash_free_state(void) {
   if (rx_vm != NULL) {
     randomx_destroy_vm(rx_vm);
     rx_vm = NULL;
+    rx_vm_dataset = NULL;
   }
 }
 
 void rx_stop_mining(void) {
+  int n;
   CTHR_MUTEX_LOCK(rx_dataset_mutex);
-  if (rx_dataset != NULL) {
-    randomx_dataset *rd = rx_dataset;
-    rx_dataset = NULL;
-    randomx_release_dataset(rd);
+  for (n=0; n<RX_MAX_NODES; n++) {
+    if (rx_dataset[n] != NULL) {
+      randomx_dataset *rd = rx_dataset[n];
+      rx_dataset[n] = NULL;
+      randomx_release_dataset(rd);
+    }
+    /* one being built is released by its builder when done */
+    if (rx_dataset_next[n] != NULL && rx_dataset_building != n) {
+      randomx_dataset *rd = rx_dataset_next[n];
+      rx_dataset_next[n] = NULL;
+      randomx_release_dataset(rd);
+    }
   }
   rx_dataset_nomem = 0;
   CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
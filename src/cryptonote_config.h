@@ -143,7 +143,14 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60)     // 5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_DANDELIONPP                    0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_DANDELIONPP)
+
+#define DANDELIONPP_STEMS                               2          // outgoing peers used as stems in an epoch
+#define DANDELIONPP_FLUFF_PROBABILITY                   10         // percent of epochs in which a node fluffs others' txes
+#define DANDELIONPP_MIN_EPOCH                           (10*60)    // seconds
+#define DANDELIONPP_EPOCH_RANGE                         30         // seconds, random extra length of an epoch
+#define DANDELIONPP_EMBARGO_AVERAGE                     39         // seconds before fluffing a stem tx we did not see fluffed
 
 #define CRYPTONOTE_NAME                                 "gntl"
 #define CRYPTONOTE_POOLDATA_FILENAME                    "poolstate.bin"
@@ -129,9 +129,12 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_difficulty_for_next_block(1),
   m_btc_valid(false),
   m_batch_success(true),
-  m_prepare_height(0)
+  m_prepare_height(0),
+  m_prefetch_cancel(false),
+  m_longhash_prewarmed_seed(crypto::null_hash)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  m_prefetched_span.valid = false;
 }
 //------------------------------------------------------------------
 bool Blockchain::have_tx(const crypto::hash &id) const
@@ -466,6 +469,8 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
       return false;
   }
 
+  prewarm_longhash();
+
   if (zmq_enabled)
   {
     try
@@ -532,6 +537,9 @@ bool Blockchain::deinit()
 
   MTRACE("Stopping blockchain read/write activity");
 
+  wait_for_prefetch(true);
+  m_longhash_prewarmer.join();
+
  // stop async service
   m_async_work_idle.reset();
   m_async_pool.join_all();
@@ -627,6 +635,9 @@ block Blockchain::pop_block_from_blockchain()
 
   CHECK_AND_ASSERT_THROW_MES(m_db->height() > 1, "It is forbidden to remove GNTL Genesis Block.");
 
+  // prefetched outputs may be about to go away
+  wait_for_prefetch(true);
+
   try
   {
     m_db->pop_block(popped_block, popped_txs);
@@ -1417,6 +1428,7 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
   uint64_t already_generated_coins;
   uint64_t pool_cookie;
 
+  bool update_cached = false;
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
   if (m_btc_valid && !from_block) {
     // The pool cookie is atomic. The lack of locking is OK, as if it changes
@@ -1432,10 +1444,51 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
       expected_reward = m_btc_expected_reward;
       return true;
     }
-    MDEBUG("Not using cached template: address " << (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address))) << ", nonce " << (m_btc_nonce == ex_nonce) << ", cookie " << (m_btc_pool_cookie == m_tx_pool.cookie()) << ", from_block " << (!from_block));
+    if (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address)) && m_btc_nonce == ex_nonce && m_btc.prev_id == get_tail_id()) {
+      // only the pool changed, so the cached template can be brought up to date
+      b = m_btc;
+      diffic = m_btc_difficulty;
+      height = m_btc_height;
+      median_weight = m_btc_median_weight;
+      already_generated_coins = m_btc_already_generated_coins;
+      pool_cookie = m_btc_pool_cookie;
+      update_cached = true;
+    }
+    else
+    {
+      MDEBUG("Not using cached template: address " << (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address))) << ", nonce " << (m_btc_nonce == ex_nonce) << ", cookie " << (m_btc_pool_cookie == m_tx_pool.cookie()) << ", from_block " << (!from_block));
+      invalidate_block_template_cache();
+    }
+  }
+  CRITICAL_REGION_END();
+
+  // the pool locks the blockchain after itself, so this is done unlocked
+  if (update_cached)
+  {
+    size_t txs_weight;
+    uint64_t fee;
+    const uint64_t new_pool_cookie = m_tx_pool.cookie();
+    const bool updated = m_tx_pool.update_block_template(b, pool_cookie, median_weight, already_generated_coins, txs_weight, fee, expected_reward, b.major_version);
+
+    CRITICAL_REGION_BEGIN(m_blockchain_lock);
+    // the chain may have moved on, or the cache been dropped, while unlocked
+    if (updated && m_btc_valid && b.prev_id == get_tail_id())
+    {
+      MDEBUG("Updated cached template");
+      b.timestamp = std::max<uint64_t>(b.timestamp, time(NULL));
+      if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, txs_weight, fee, miner_address, ex_nonce))
+        return false;
+      cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, new_pool_cookie, median_weight, already_generated_coins);
+      return true;
+    }
+    MDEBUG("Not using cached template: " << (updated ? "chain changed while updating" : "pool changed since the last block"));
     invalidate_block_template_cache();
+    CRITICAL_REGION_END();
+    b = block();
   }
 
+  CRITICAL_REGION_BEGIN(m_blockchain_lock);
+
   if (from_block)
   {
     //build alternative subchain, front -> mainchain, back -> alternative head
@@ -1528,11 +1581,12 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
 
   size_t txs_weight;
   uint64_t fee;
+  // before filling, so txes added meanwhile are picked up by the next update
+  pool_cookie = m_tx_pool.cookie();
   if (!m_tx_pool.fill_block_template(b, median_weight, already_generated_coins, txs_weight, fee, expected_reward, b.major_version))
   {
     return false;
   }
-  pool_cookie = m_tx_pool.cookie();
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   size_t real_txs_weight = 0;
   uint64_t real_fee = 0;
@@ -1588,6 +1642,16 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
       ", fee " << fee);
 #endif
 
+  if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, txs_weight, fee, miner_address, ex_nonce))
+    return false;
+
+  if (!from_block)
+    cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, pool_cookie, median_weight, already_generated_coins);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::construct_block_template_miner_tx(block &b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address &miner_address, const blobdata &ex_nonce)
+{
   /*
    two-phase miner transaction generation: we don't know exact block weight until we prepare block, but we don't know reward until we know
    block weight, so first miner transaction generated with fake amount of money, and with phase we know think we know expected block weight
@@ -1648,8 +1712,6 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
         ", cumulative weight " << cumulative_weight << " is now good");
 #endif
 
-    if (!from_block)
-      cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, pool_cookie);
     return true;
   }
   LOG_ERROR("Failed to create_block_template with " << 10 << " tries");
@@ -2082,7 +2144,7 @@ crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_i
 bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   res.outs.clear();
   res.outs.reserve(req.outputs.size());
@@ -2155,12 +2217,9 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
     return false;
   if (amount == 0)
   {
-    std::vector<uint64_t> heights;
-    heights.reserve(to_height + 1 - start_height);
     const uint64_t real_start_height = start_height > 0 ? start_height-1 : start_height;
-    for (uint64_t h = real_start_height; h <= to_height; ++h)
-      heights.push_back(h);
-    distribution = m_db->get_block_cumulative_rct_outputs(heights);
+    if (!m_db->get_rct_output_distribution(real_start_height, to_height, distribution))
+      return false;
     if (start_height > 0)
     {
       base = distribution[0];
@@ -2180,7 +2239,7 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
 bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, uint64_t& starter_offset) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   // make sure the request includes at least the genesis block, otherwise
   // how can we expect to sync from the client that the block list came from?
@@ -2190,7 +2249,6 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  db_rtxn_guard rtxn_guard(m_db);
   // make sure that the last block in the request's block list matches
   // the genesis block
   auto gen_hash = m_db->get_block_hash_from_height(0);
@@ -2343,7 +2401,7 @@ static bool fill(BlockchainDB *db, const crypto::hash &tx_hash, tx_blob_entry &t
 bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   txs.reserve(txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2367,7 +2425,7 @@ bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids
 bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids, std::vector<tx_blob_entry>& txs, std::vector<crypto::hash>& missed_txs, bool pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   txs.reserve(txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2403,7 +2461,7 @@ template<class t_ids_container, class t_tx_container, class t_missed_container>
 bool Blockchain::get_split_transactions_blobs(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   reserve_container(txs, txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2437,7 +2495,7 @@ template<class t_ids_container, class t_tx_container, class t_missed_container>
 bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   reserve_container(txs, txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -2471,7 +2529,7 @@ bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container
 bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::vector<crypto::hash>& hashes, std::vector<uint64_t>* weights, uint64_t& start_height, uint64_t& current_height, bool clip_pruned) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   // if we can't find the split point, return false
   if(!find_blockchain_supplement(qblock_ids, start_height))
@@ -2479,7 +2537,6 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  db_rtxn_guard rtxn_guard(m_db);
   current_height = get_current_blockchain_height();
   uint64_t stop_height = current_height;
   if (clip_pruned)
@@ -2510,7 +2567,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, bool clip_pruned, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   bool result = find_blockchain_supplement(qblock_ids, resp.m_block_ids, &resp.m_block_weights, resp.start_height, resp.total_height, clip_pruned);
   if (result)
@@ -2526,7 +2583,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
 
   // if a specific start height has been requested
   if(req_start_block > 0)
@@ -2546,7 +2603,6 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     }
   }
 
-  db_rtxn_guard rtxn_guard(m_db);
   total_height = get_current_blockchain_height();
   blocks.reserve(std::min(std::min(max_count, (size_t)10000), (size_t)(total_height - start_height)));
   CHECK_AND_ASSERT_MES(m_db->get_blocks_from(start_height, 3, max_count, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE, blocks, pruned, true, get_miner_tx_hash), false, "Error getting blocks");
@@ -2684,7 +2740,7 @@ bool Blockchain::check_for_double_spend(const transaction& tx, key_images_contai
 bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes, std::vector<std::vector<uint64_t>>& indexs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
   uint64_t tx_index;
   if (!m_db->tx_exists(tx_id, tx_index))
   {
@@ -2700,7 +2756,7 @@ bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, size_t n_txes
 bool Blockchain::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_snapshot snapshot(m_db);
   uint64_t tx_index;
   if (!m_db->tx_exists(tx_id, tx_index))
   {
@@ -2948,7 +3004,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction &tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height) const
+bool Blockchain::check_tx_inputs(transaction &tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, std::vector<const rct::rctSig*> *deferred_rct) const
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3227,7 +3283,11 @@ bool Blockchain::check_tx_inputs(transaction &tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRctNonSemanticsSimple(rv))
+      if (deferred_rct)
+      {
+        deferred_rct->push_back(&rv);
+      }
+      else if (!rct::verRctNonSemanticsSimple(rv))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -3871,6 +3931,8 @@ leave:
 // XXX old code adds miner tx here
 
   size_t tx_index = 0;
+  // simple ringct signatures are verified for the whole block at once
+  std::vector<const rct::rctSig*> deferred_rct;
   // Iterate over the block's transaction hashes, grabbing each
   // from the tx_pool and validating them.  Each is then added
   // to txs.  Keys spent in each are added to <keys> by the double spend check.
@@ -3940,7 +4002,7 @@ leave:
     {
       // validate that transaction inputs and the keys spending them are correct.
       tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      if(!check_tx_inputs(tx, tvc, NULL, &deferred_rct))
       {
         MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
 
@@ -3977,6 +4039,23 @@ leave:
     cumulative_block_weight += tx_weight;
   }
 
+  if (!deferred_rct.empty())
+  {
+    TIME_MEASURE_START(rct);
+    const bool rct_ok = rct::verRctNonSemanticsSimple(deferred_rct);
+    TIME_MEASURE_FINISH(rct);
+    t_checktx += rct;
+    if (!rct_ok)
+    {
+      MERROR_VER("Block with id: " << id << " has at least one transaction with invalid ringct signatures");
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verifivation_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+  }
+
   if(n_pruned > 0)
   {
     if(blockchain_height >= m_blocks_hash_check.size() || m_blocks_hash_check[blockchain_height].second == 0)
@@ -4080,6 +4159,7 @@ leave:
   m_tx_pool.on_blockchain_inc(new_height, id);
   get_difficulty_for_next_block(); // just to cache it
   invalidate_block_template_cache();
+  prewarm_longhash();
 
 
   if (zmq_enabled)
@@ -4359,6 +4439,12 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
     if (m_cancel)
        break;
     crypto::hash id = get_block_hash(block);
+    if (m_blocks_longhash_table.find(id) != m_blocks_longhash_table.end())
+    {
+      // already computed by prefetch_incoming_blocks
+      ++height;
+      continue;
+    }
     crypto::hash pow = get_block_longhash(this, block, height++, 0);
     map.emplace(id, pow);
   }
@@ -4380,7 +4466,11 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
     if(m_batch_success)
       m_db->batch_stop();
     else
+    {
       m_db->batch_abort();
+      // the next span was prefetched against a chain we're rolling back
+      wait_for_prefetch(true);
+    }
     success = true;
   }
   catch (const std::exception& e)
@@ -4600,6 +4690,9 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   size_t total_txs = 0;
   blocks.clear();
 
+  // the previous span may have started preprocessing this one
+  wait_for_prefetch(false);
+
   // Order of locking must be:
   //  m_incoming_tx_lock (optional)
   //  m_tx_pool lock
@@ -4644,6 +4737,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     return true;
 
   bool blocks_exist = false;
+  bool prefetched = false;
   tools::threadpool& tpool = tools::threadpool::getInstance();
   unsigned threads = tpool.get_max_concurrency();
   blocks.resize(blocks_entry.size());
@@ -4703,9 +4797,17 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       std::advance(it, 1);
     }
 
+    prefetched = m_prefetched_span.valid && m_prefetched_span.height == height && m_prefetched_span.block_hashes.size() == blocks.size();
+    for (size_t i = 0; prefetched && i < blocks.size(); ++i)
+      prefetched = get_block_hash(blocks[i]) == m_prefetched_span.block_hashes[i];
+    if (prefetched)
+      MDEBUG("Using prefetched data for blocks " << height << " - " << (height + blocks.size() - 1));
+
     if (!blocks_exist)
     {
       m_blocks_longhash_table.clear();
+      if (prefetched)
+        m_blocks_longhash_table = std::move(m_prefetched_span.longhashes);
       uint64_t thread_height = height;
       tools::threadpool::waiter waiter;
       m_prepare_height = height;
@@ -4761,7 +4863,14 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   std::map<uint64_t, std::vector<uint64_t>> offset_map;
   // [output] stores all output_data_t for each absolute_offset
   std::map<uint64_t, std::vector<output_data_t>> tx_map;
-  std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
+  std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes;
+  if (prefetched && m_prefetched_span.txes.size() == total_txs)
+    txes = std::move(m_prefetched_span.txes);
+  else
+  {
+    prefetched = false;
+    txes.resize(total_txs);
+  }
 
 #define SCAN_TABLE_QUIT(m) \
         do { \
@@ -4785,9 +4894,12 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       crypto::hash &tx_prefix_hash = txes[tx_index].second;
       ++tx_index;
 
-      if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
-        SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
-      cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
+      if (!prefetched)
+      {
+        if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
+          SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
+        cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
+      }
 
       auto its = m_scan_table.find(tx_prefix_hash);
       if (its != m_scan_table.end())
@@ -4847,31 +4959,57 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     offsets.second.erase(last, offsets.second.end());
   }
 
+  // the prefetched outputs are a prefix of the sorted offsets, only get the rest
+  std::map<uint64_t, std::vector<uint64_t>> missing_offset_map;
+  std::map<uint64_t, std::vector<output_data_t>> missing_tx_map;
+  for (const uint64_t amount : amounts)
+  {
+    const std::vector<uint64_t> &offsets = offset_map[amount];
+    std::vector<output_data_t> &outputs = tx_map[amount];
+    if (prefetched)
+    {
+      auto pit = m_prefetched_span.outputs.find(amount);
+      if (pit != m_prefetched_span.outputs.end() && pit->second.size() <= offsets.size())
+        outputs = std::move(pit->second);
+    }
+    if (outputs.size() < offsets.size())
+    {
+      missing_offset_map[amount].assign(offsets.begin() + outputs.size(), offsets.end());
+      missing_tx_map[amount];
+    }
+  }
+
   // gather all the output keys
   threads = tpool.get_max_concurrency();
   if (!m_db->can_thread_bulk_indices())
     threads = 1;
 
-  if (threads > 1 && amounts.size() > 1)
+  if (threads > 1 && missing_offset_map.size() > 1)
   {
     tools::threadpool::waiter waiter;
 
-    for (size_t i = 0; i < amounts.size(); i++)
+    for (const auto &offsets : missing_offset_map)
     {
-      uint64_t amount = amounts[i];
-      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount])), true);
+      uint64_t amount = offsets.first;
+      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offsets.second), std::ref(missing_tx_map[amount])), true);
     }
     waiter.wait(&tpool);
   }
   else
   {
-    for (size_t i = 0; i < amounts.size(); i++)
+    for (const auto &offsets : missing_offset_map)
     {
-      uint64_t amount = amounts[i];
-      output_scan_worker(amount, offset_map[amount], tx_map[amount]);
+      uint64_t amount = offsets.first;
+      output_scan_worker(amount, offsets.second, missing_tx_map[amount]);
     }
   }
 
+  for (auto &outputs : missing_tx_map)
+  {
+    std::vector<output_data_t> &dst = tx_map[outputs.first];
+    dst.insert(dst.end(), outputs.second.begin(), outputs.second.end());
+  }
+
   // now generate a table for each tx_prefix and k_image hashes
   tx_index = 0;
   for (const auto &entry : blocks_entry)
@@ -4932,9 +5070,181 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       MDEBUG("Prepare scantable took: " << scantable << " ms");
   }
 
+  // whatever was prefetched has been used up
+  wait_for_prefetch(true);
+
   return true;
 }
 
+//------------------------------------------------------------------
+void Blockchain::prefetch_incoming_blocks(uint64_t height, std::vector<block_complete_entry> &&blocks_entry)
+{
+  MTRACE("Blockchain::" << __func__);
+
+  wait_for_prefetch(true);
+
+  if (blocks_entry.empty() || m_cancel)
+    return;
+
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    // those will be fast checked against the precomputed hashes anyway
+    if ((height + blocks_entry.size()) < m_blocks_hash_check.size())
+      return;
+  }
+
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  m_prefetch_cancel = false;
+  // the thread owns the span, which the caller has no more use for
+  m_prefetch_thread = boost::thread([this, height, blocks_entry = std::move(blocks_entry)]() {
+    prefetch_span_worker(height, blocks_entry);
+  });
+}
+
+//------------------------------------------------------------------
+void Blockchain::wait_for_prefetch(bool invalidate)
+{
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  if (m_prefetch_thread.joinable())
+  {
+    if (invalidate)
+      m_prefetch_cancel = true;
+    m_prefetch_thread.join();
+  }
+  if (invalidate)
+  {
+    m_prefetched_span.valid = false;
+    m_prefetched_span.block_hashes.clear();
+    m_prefetched_span.longhashes.clear();
+    m_prefetched_span.txes.clear();
+    m_prefetched_span.outputs.clear();
+  }
+}
+
+//------------------------------------------------------------------
+// Runs the stages of prepare_handle_incoming_blocks which do not depend on the
+// span before this one being committed:
+// 1. parse blocks and txes
+// 2. long hashes for blocks whose seed block is already in the db
+// 3. output keys already in the db, as a prefix of the sorted offsets per amount
+// Anything else is left for prepare_handle_incoming_blocks to do.
+void Blockchain::prefetch_span_worker(uint64_t height, const std::vector<block_complete_entry> &blocks_entry)
+{
+  TIME_MEASURE_START(prefetch);
+  prefetched_span_t &span = m_prefetched_span;
+  span.valid = false;
+  span.height = height;
+  span.block_hashes.clear();
+  span.longhashes.clear();
+  span.txes.clear();
+  span.outputs.clear();
+
+  try
+  {
+    std::vector<block> blocks(blocks_entry.size());
+    size_t total_txs = 0;
+    for (size_t i = 0; i < blocks_entry.size(); ++i)
+    {
+      crypto::hash block_hash;
+      if (!parse_and_validate_block_from_blob(blocks_entry[i].block, blocks[i], block_hash))
+        return;
+      if (i > 0 && blocks[i].prev_id != span.block_hashes.back())
+        return;
+      span.block_hashes.push_back(block_hash);
+      total_txs += blocks_entry[i].txs.size();
+    }
+
+    // the seed block may be in the span being committed, skip those
+    const uint64_t db_height = m_db->height();
+    std::vector<std::pair<size_t, crypto::hash>> to_hash;
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      crypto::hash seed_hash = crypto::null_hash;
+      if (blocks[i].major_version >= RX_BLOCK_VERSION)
+      {
+        const uint64_t seed_height = rx_seedheight(height + i);
+        if (seed_height >= db_height)
+          continue;
+        seed_hash = m_db->get_block_hash_from_height(seed_height);
+      }
+      to_hash.push_back(std::make_pair(i, seed_hash));
+    }
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    unsigned threads = std::min<unsigned>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads);
+    threads = std::max(1u, std::min<unsigned>(threads, to_hash.size()));
+    std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
+    tools::threadpool::waiter waiter;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+      tpool.submit(&waiter, [&, t]() {
+        for (size_t n = t; n < to_hash.size(); n += threads)
+        {
+          if (m_cancel || m_prefetch_cancel)
+            break;
+          const size_t idx = to_hash[n].first;
+          crypto::hash pow;
+          get_block_longhash(blocks[idx], pow, height + idx, to_hash[n].second);
+          maps[t].emplace(span.block_hashes[idx], pow);
+        }
+      }, true);
+    }
+    waiter.wait(&tpool);
+    if (m_cancel || m_prefetch_cancel)
+      return;
+    for (const auto &map : maps)
+      span.longhashes.insert(map.begin(), map.end());
+
+    std::map<uint64_t, std::vector<uint64_t>> offset_map;
+    span.txes.resize(total_txs);
+    size_t tx_index = 0;
+    for (const auto &entry : blocks_entry)
+    {
+      for (const auto &tx_blob : entry.txs)
+      {
+        transaction &tx = span.txes[tx_index].first;
+        if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
+          return;
+        cryptonote::get_transaction_prefix_hash(tx, span.txes[tx_index].second);
+        ++tx_index;
+        for (const auto &txin : tx.vin)
+        {
+          if (txin.type() != typeid(txin_to_key))
+            return;
+          const txin_to_key &in_to_key = boost::get<txin_to_key>(txin);
+          const std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
+          std::vector<uint64_t> &offsets = offset_map[in_to_key.amount];
+          offsets.insert(offsets.end(), absolute_offsets.begin(), absolute_offsets.end());
+        }
+      }
+      if (m_cancel || m_prefetch_cancel)
+        return;
+    }
+
+    // outputs created by the span being committed are not there yet, and
+    // will be missing from the end of the (partial) results
+    for (auto &offsets : offset_map)
+    {
+      if (m_cancel || m_prefetch_cancel)
+        return;
+      std::sort(offsets.second.begin(), offsets.second.end());
+      offsets.second.erase(std::unique(offsets.second.begin(), offsets.second.end()), offsets.second.end());
+      output_scan_worker(offsets.first, offsets.second, span.outputs[offsets.first]);
+    }
+
+    span.valid = true;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Exception prefetching blocks: " << e.what());
+    return;
+  }
+
+  TIME_MEASURE_FINISH(prefetch);
+  if (m_show_time_stats)
+    MDEBUG("Prefetched " << blocks_entry.size() << " blocks in " << prefetch << " ms");
+}
+
 void Blockchain::add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata &blob, const txpool_tx_meta_t &meta)
 {
   m_db->add_txpool_tx(txid, blob, meta);
@@ -5259,7 +5569,33 @@ void Blockchain::invalidate_block_template_cache()
   m_btc_valid = false;
 }
 
-void Blockchain::cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie)
+void Blockchain::prewarm_longhash()
+{
+  const uint64_t height = m_db->height();
+  if (height == 0 || m_hardfork->get_current_version() < RX_BLOCK_VERSION)
+    return;
+
+  // the next seed block is always in the chain already, so its cache can be
+  // built before the first block using it arrives
+  uint64_t seed_height, next_height;
+  rx_seedheights(height, &seed_height, &next_height);
+  std::vector<std::pair<uint64_t, crypto::hash>> seeds;
+  if (m_longhash_prewarmed_seed == crypto::null_hash)
+    seeds.push_back(std::make_pair(seed_height, m_db->get_block_hash_from_height(seed_height)));
+  const crypto::hash next_hash = m_db->get_block_hash_from_height(next_height);
+  if (next_hash != m_longhash_prewarmed_seed && (seeds.empty() || seeds[0].second != next_hash))
+    seeds.push_back(std::make_pair(next_height, next_hash));
+  if (seeds.empty())
+    return;
+
+  // if the last seeds are still being worked on, this is retried on the next block
+  if (!m_longhash_prewarmer.start(seeds))
+    return;
+  m_longhash_prewarmed_seed = next_hash;
+  MDEBUG("Prewarming RandomX for seed height " << next_height);
+}
+
+void Blockchain::cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins)
 {
   MDEBUG("Setting block template cache");
   m_btc = b;
@@ -5269,6 +5605,8 @@ void Blockchain::cache_block_template(const block &b, const cryptonote::account_
   m_btc_height = height;
   m_btc_expected_reward = expected_reward;
   m_btc_pool_cookie = pool_cookie;
+  m_btc_median_weight = median_weight;
+  m_btc_already_generated_coins = already_generated_coins;
   m_btc_valid = true;
 }
 
@@ -56,6 +56,7 @@
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
 #include "cryptonote_tx_utils.h"
+#include "longhash_prewarm.h"
 #include "cryptonote_basic/verification_context.h"
 #include "crypto/hash.h"
 #include "checkpoints/checkpoints.h"
@@ -237,6 +238,21 @@ namespace cryptonote
      */
     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks);
 
+    /**
+     * @brief starts preprocessing the span following the one being added
+     *
+     * Parses the blocks and their transactions, computes proof of work and
+     * prefetches the output keys already in the db for the given span in a
+     * background thread, so that this overlaps with verification and commit
+     * of the current span. The results are used by the next call to
+     * prepare_handle_incoming_blocks if it is for the same blocks, and are
+     * discarded otherwise.
+     *
+     * @param height the height of the first block of the span
+     * @param blocks_entry the blocks of the span, handed over to the prefetch thread
+     */
+    void prefetch_incoming_blocks(uint64_t height, std::vector<block_complete_entry> &&blocks_entry);
+
     /**
      * @brief incoming blocks post-processing, cleanup, and disk sync
      *
@@ -964,6 +980,23 @@ namespace cryptonote
      */
     void block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
+    /**
+     * @brief preprocesses a span ahead of prepare_handle_incoming_blocks
+     *
+     * Runs in its own thread, and only reads committed db state.
+     *
+     * @param height the height of the first block of the span
+     * @param blocks_entry the blocks of the span
+     */
+    void prefetch_span_worker(uint64_t height, const std::vector<block_complete_entry> &blocks_entry);
+
+    /**
+     * @brief waits for a pending prefetch, and drops its results if requested
+     *
+     * @param invalidate whether to discard the prefetched data
+     */
+    void wait_for_prefetch(bool invalidate);
+
     /**
      * @brief returns a set of known alternate chains
      *
@@ -1100,6 +1133,8 @@ namespace cryptonote
     uint64_t m_btc_height;
     uint64_t m_btc_pool_cookie;
     uint64_t m_btc_expected_reward;
+    size_t m_btc_median_weight;
+    uint64_t m_btc_already_generated_coins;
     bool m_btc_valid;
 
     bool m_batch_success;
@@ -1121,6 +1156,24 @@ namespace cryptonote
     uint64_t m_prepare_nblocks;
     std::vector<block> *m_prepare_blocks;
 
+    // for prefetch_incoming_blocks
+    struct prefetched_span_t
+    {
+      uint64_t height;
+      std::vector<crypto::hash> block_hashes;
+      std::unordered_map<crypto::hash, crypto::hash> longhashes;
+      std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes;
+      std::map<uint64_t, std::vector<output_data_t>> outputs;
+      bool valid;
+    };
+    prefetched_span_t m_prefetched_span;
+    boost::thread m_prefetch_thread;
+    boost::mutex m_prefetch_lock;
+    std::atomic<bool> m_prefetch_cancel;
+
+    crypto::hash m_longhash_prewarmed_seed;
+    longhash_prewarmer m_longhash_prewarmer;
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1177,15 +1230,18 @@ namespace cryptonote
      * of the most recent block which contains an output used in any input set
      *
      * Currently this function calls ring signature validation for each
-     * transaction.
+     * transaction, unless deferred_rct is not NULL, in which case simple
+     * ringct signatures are appended to it for the caller to batch verify
+     * with rct::verRctNonSemanticsSimple.
      *
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred_rct if not NULL, collects the rct signatures left to verify
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL) const;
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, std::vector<const rct::rctSig*> *deferred_rct = NULL) const;
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1509,11 +1565,30 @@ namespace cryptonote
      */
     void invalidate_block_template_cache();
 
+    /**
+     * @brief builds the RandomX cache for the current and next seed in the background
+     *
+     * Verifying the first blocks after a seed change would otherwise stall
+     * on building the cache for the new seed. While mining, the dataset for
+     * the next seed is built too, and swapped in at the seed change.
+     */
+    void prewarm_longhash();
+
      /**
      * @brief stores a new cached block template
      *
      * At some point, may be used to push an update to miners
      */
-    void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie);
+    void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins);
+
+    /**
+     * @brief builds the miner tx for a block template whose txes are chosen
+     *
+     * The miner tx is padded so the block weight it was built for matches
+     * the weight of the resulting block.
+     *
+     * @return true on success, false otherwise
+     */
+    bool construct_block_template_miner_tx(block &b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address &miner_address, const blobdata &ex_nonce);
   };
 }  // namespace cryptonote
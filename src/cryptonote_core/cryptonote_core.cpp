@@ -49,6 +49,7 @@ using namespace epee;
 #include "cryptonote_config.h"
 #include "misc_language.h"
 #include "file_io_utils.h"
+#include "profile_tools.h"
 #include <csignal>
 #include "checkpoints/checkpoints.h"
 #include "ringct/rctTypes.h"
@@ -183,6 +184,11 @@ namespace cryptonote
   , "Pad relayed transactions to help defend against traffic volume analysis"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_no_dandelionpp = {
+    "no-dandelionpp"
+  , "Flood new transactions to all peers at once, without a Dandelion++ stem phase"
+  , false
+  };
   static const command_line::arg_descriptor<size_t> arg_max_txpool_weight = {
     "max-txpool-weight"
   , "Set maximum txpool weight in bytes."
@@ -227,7 +233,8 @@ namespace cryptonote
               m_update_download(0),
               m_nettype(UNDEFINED),
               m_update_available(false),
-              m_pad_transactions(false)
+              m_pad_transactions(false),
+              m_dandelionpp_enabled(true)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -324,6 +331,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_sync_pruned_blocks);
     command_line::add_arg(desc, arg_max_txpool_weight);
     command_line::add_arg(desc, arg_pad_transactions);
+    command_line::add_arg(desc, arg_no_dandelionpp);
     command_line::add_arg(desc, arg_block_notify);
     command_line::add_arg(desc, arg_prune_blockchain);
     command_line::add_arg(desc, arg_reorg_notify);
@@ -365,6 +373,7 @@ namespace cryptonote
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = !get_arg(vm, arg_no_fluffy_blocks);
     m_pad_transactions = get_arg(vm, arg_pad_transactions);
+    m_dandelionpp_enabled = !get_arg(vm, arg_no_dandelionpp);
     m_offline = get_arg(vm, arg_offline);
     m_disable_dns_checkpoints = get_arg(vm, arg_disable_dns_checkpoints);
     if (!command_line::is_arg_defaulted(vm, arg_fluffy_blocks))
@@ -561,6 +570,13 @@ namespace cryptonote
           sync_mode = db_sync_mode_is_default ? db_defaultsync : db_sync;
         else if(options[1] == "async")
           sync_mode = db_sync_mode_is_default ? db_defaultsync : db_async;
+        else if(options[1] == "writebehind")
+        {
+          // every commit is flushed by the db in the background, which
+          // relies on the data pages being synced before the meta page
+          db_flags = (db_flags & ~(DBF_FAST | DBF_FASTEST)) | DBF_WRITE_BEHIND;
+          sync_mode = db_sync_mode_is_default ? db_defaultsync : db_nosync;
+        }
       }
 
       if(options.size() >= 3 && !safemode)
@@ -586,6 +602,8 @@ namespace cryptonote
 
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
+      if (command_line::get_arg(vm, cryptonote::arg_db_compress))
+        db_flags |= DBF_COMPRESS;
 
       db->open(filename, db_flags);
       if(!db->m_open)
@@ -939,6 +957,8 @@ namespace cryptonote
             tx_info[n].result = false;
             break;
           }
+          if (m_incoming_blocks_semantics_verified_txes.find(tx_info[n].tx_hash) != m_incoming_blocks_semantics_verified_txes.end())
+            break; // already verified with the rest of its span
           rvv.push_back(&rv); // delayed batch verification
           break;
         default:
@@ -972,6 +992,59 @@ namespace cryptonote
     return ret;
   }
   //-----------------------------------------------------------------------------------------------
+  void core::batch_verify_incoming_blocks_txs_semantics(const std::vector<block_complete_entry> &blocks_entry)
+  {
+    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+    m_incoming_blocks_semantics_verified_txes.clear();
+
+    if (get_blockchain_storage().is_within_compiled_block_hash_area())
+      return;
+
+    // pruned txes have no bulletproofs to check
+    std::vector<const blobdata*> blobs;
+    for (const auto &entry: blocks_entry)
+      for (const auto &tx_blob: entry.txs)
+        if (tx_blob.prunable_hash == crypto::null_hash)
+          blobs.push_back(&tx_blob.blob);
+    if (blobs.size() < 2)
+      return;
+
+    TIME_MEASURE_START(t);
+    struct parsed { transaction tx; crypto::hash hash; bool usable; };
+    std::vector<parsed> txes(blobs.size());
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+      tpool.submit(&waiter, [&, i] {
+        parsed &p = txes[i];
+        p.usable = parse_and_validate_tx_from_blob(*blobs[i], p.tx, p.hash) && p.tx.version >= 2 &&
+            p.tx.rct_signatures.type == rct::RCTTypeBulletproof && is_canonical_bulletproof_layout(p.tx.rct_signatures.p.bulletproofs);
+      }, true);
+    }
+    waiter.wait(&tpool);
+
+    std::vector<const rct::rctSig*> rvv;
+    std::vector<const crypto::hash*> hashes;
+    for (const parsed &p: txes)
+    {
+      if (!p.usable)
+        continue;
+      rvv.push_back(&p.tx.rct_signatures);
+      hashes.push_back(&p.hash);
+    }
+    if (rvv.empty())
+      return;
+
+    // those which fail will be verified (and rejected) again with their block
+    const std::vector<bool> valid = rct::verRctSemanticsSimpleEach(rvv);
+    for (size_t n = 0; n < rvv.size(); ++n)
+      if (valid[n])
+        m_incoming_blocks_semantics_verified_txes.insert(*hashes[n]);
+    TIME_MEASURE_FINISH(t);
+    MDEBUG("Batch verified semantics of " << m_incoming_blocks_semantics_verified_txes.size() << "/" << rvv.size() << " txes in " << t << " ms");
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::handle_incoming_txs(const std::vector<tx_blob_entry>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
   {
     TRY_ENTRY();
@@ -1173,6 +1246,8 @@ namespace cryptonote
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
     spent.clear();
+    spent.reserve(key_im.size());
+    db_snapshot snapshot(&m_blockchain_storage.get_db()); // one read txn for the whole batch
     for(auto& ki: key_im)
     {
       spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
@@ -1315,6 +1390,8 @@ namespace cryptonote
       {
         r.txs.push_back(it->second);
       }
+      // these were already due to be public, no point stemming them again
+      r.dandelionpp_fluff = true;
       get_protocol()->relay_transactions(r, fake_context);
       m_mempool.set_relayed(txs);
     }
@@ -1478,9 +1555,16 @@ namespace cryptonote
       cleanup_handle_incoming_blocks(false);
       return false;
     }
+    batch_verify_incoming_blocks_txs_semantics(blocks_entry);
     return true;
   }
 
+  //-----------------------------------------------------------------------------------------------
+  void core::prefetch_incoming_blocks(uint64_t height, const std::vector<block_complete_entry> &blocks_entry)
+  {
+    m_blockchain_storage.prefetch_incoming_blocks(height, std::move(blocks_entry));
+  }
+
   //-----------------------------------------------------------------------------------------------
   bool core::cleanup_handle_incoming_blocks(bool force_sync)
   {
@@ -1489,6 +1573,7 @@ namespace cryptonote
       success = m_blockchain_storage.cleanup_handle_incoming_blocks(force_sync);
     }
     catch (...) {}
+    m_incoming_blocks_semantics_verified_txes.clear();
     m_incoming_tx_lock.unlock();
     return success;
   }
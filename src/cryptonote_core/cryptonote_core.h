@@ -167,6 +167,13 @@ namespace cryptonote
       */
      bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks);
 
+     /**
+      * @copydoc Blockchain::prefetch_incoming_blocks
+      *
+      * @note see Blockchain::prefetch_incoming_blocks
+      */
+     void prefetch_incoming_blocks(uint64_t height, std::vector<block_complete_entry> &&blocks_entry);
+
      /**
       * @copydoc Blockchain::cleanup_handle_incoming_blocks
       *
@@ -762,6 +769,13 @@ namespace cryptonote
       */
      bool pad_transactions() const { return m_pad_transactions; }
 
+     /**
+      * @brief get whether transactions are relayed along a Dandelion++ stem before being fluffed
+      *
+      * @return whether Dandelion++ relay is enabled
+      */
+     bool dandelionpp_enabled() const { return m_dandelionpp_enabled; }
+
      /**
       * @brief check a set of hashes against the precompiled hash set
       *
@@ -914,6 +928,18 @@ namespace cryptonote
      struct tx_verification_batch_info { const cryptonote::transaction *tx; crypto::hash tx_hash; tx_verification_context &tvc; bool &result; };
      bool handle_incoming_tx_accumulated_batch(std::vector<tx_verification_batch_info> &tx_info, bool keeped_by_block);
 
+     /**
+      * @brief batch verifies the bulletproof rct semantics of all txes in a set of incoming blocks
+      *
+      * All the bulletproofs go through one multiexp, and if that fails, the
+      * set is bisected to find the bad ones. Txes which pass are remembered
+      * until cleanup_handle_incoming_blocks, and are not verified again when
+      * handle_incoming_txs is called for each block.
+      *
+      * @param blocks_entry the incoming blocks
+      */
+     void batch_verify_incoming_blocks_txs_semantics(const std::vector<block_complete_entry> &blocks_entry);
+
      /**
       * @copydoc miner::on_block_chain_update
       *
@@ -1041,6 +1067,8 @@ namespace cryptonote
      std::unordered_set<crypto::hash> bad_semantics_txes[2];
      boost::mutex bad_semantics_txes_lock;
 
+     std::unordered_set<crypto::hash> m_incoming_blocks_semantics_verified_txes; //!< guarded by m_incoming_tx_lock
+
      enum {
        UPDATES_DISABLED,
        UPDATES_NOTIFY,
@@ -1055,6 +1083,7 @@ namespace cryptonote
      bool m_fluffy_blocks_enabled;
      bool m_offline;
      bool m_pad_transactions;
+     bool m_dandelionpp_enabled;
    };
 }
 
@@ -803,6 +803,17 @@ bool construct_miner_tx(size_t height, size_t median_weight, uint64_t already_ge
     return p;
   }
 
+  bool get_block_longhash(const block& b, crypto::hash& res, const uint64_t height, const crypto::hash& seed_hash)
+  {
+    // seed hash supplied by the caller, so this can run without a Blockchain
+    // for blocks whose seed block is already known
+    if(b.major_version < RX_BLOCK_VERSION)
+      return get_block_longhash(NULL, b, res, height, 0);
+    blobdata bd = get_block_hashing_blob(b);
+    rx_slow_hash(height, rx_seedheight(height), seed_hash.data, bd.data(), bd.size(), res.data, 0, 0);
+    return true;
+  }
+
   void get_block_longhash_reorg(const uint64_t split_height)
   {
     rx_reorg(split_height);
@@ -0,0 +1,76 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/chrono/duration.hpp>
+#include "longhash_prewarm.h"
+
+namespace cryptonote
+{
+
+longhash_prewarmer::longhash_prewarmer():
+  longhash_prewarmer([](uint64_t seed_height, const crypto::hash &seed_hash) { crypto::rx_prewarm_seed(seed_height, seed_hash.data); },
+    [](uint64_t seed_height, const crypto::hash &seed_hash) { crypto::rx_prebuild_datasets(seed_height, seed_hash.data); })
+{
+}
+
+longhash_prewarmer::longhash_prewarmer(prewarm_t prewarm_cache, prewarm_t prebuild_dataset):
+  m_prewarm_cache(std::move(prewarm_cache)),
+  m_prebuild_dataset(std::move(prebuild_dataset))
+{
+}
+
+longhash_prewarmer::~longhash_prewarmer()
+{
+  try { join(); }
+  catch (...) { /* ignore */ }
+}
+
+bool longhash_prewarmer::start(const seeds_t &seeds)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  if (m_thread.joinable() && !m_thread.try_join_for(boost::chrono::milliseconds(0)))
+    return false;
+  const prewarm_t prewarm_cache = m_prewarm_cache, prebuild_dataset = m_prebuild_dataset;
+  m_thread = boost::thread([prewarm_cache, prebuild_dataset, seeds]() {
+    for (const auto &seed: seeds)
+      prewarm_cache(seed.first, seed.second);
+    if (prebuild_dataset)
+      for (const auto &seed: seeds)
+        prebuild_dataset(seed.first, seed.second);
+  });
+  return true;
+}
+
+void longhash_prewarmer::join()
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+}
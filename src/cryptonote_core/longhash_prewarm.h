@@ -0,0 +1,77 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief builds the RandomX state for upcoming seeds on a thread of its own
+   *
+   * The caches for all seeds are built first, as verification needs them,
+   * then the datasets, which are only built while mining and take much
+   * longer. None of it is a thread pool job: a thread waiting on the pool,
+   * as verification does with the blockchain locked, runs queued jobs itself
+   * while it waits.
+   */
+  class longhash_prewarmer
+  {
+  public:
+    typedef std::vector<std::pair<uint64_t, crypto::hash>> seeds_t;
+    typedef std::function<void(uint64_t, const crypto::hash&)> prewarm_t;
+
+    //! prewarms with rx_prewarm_seed, then rx_prebuild_datasets
+    longhash_prewarmer();
+    explicit longhash_prewarmer(prewarm_t prewarm_cache, prewarm_t prebuild_dataset = prewarm_t());
+    ~longhash_prewarmer();
+
+    /**
+     * @brief starts prewarming the given seeds, in order
+     *
+     * @return false if the last seeds are still being prewarmed, true otherwise
+     */
+    bool start(const seeds_t &seeds);
+
+    //! waits for the seeds being prewarmed, if any
+    void join();
+
+  private:
+    prewarm_t m_prewarm_cache;
+    prewarm_t m_prebuild_dataset;
+    boost::thread m_thread;
+    boost::mutex m_lock;
+  };
+}
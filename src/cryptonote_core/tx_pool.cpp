@@ -35,6 +35,7 @@
 #include <vector>
 
 #include "tx_pool.h"
+#include "tx_selection.h"
 #include "cryptonote_tx_utils.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_config.h"
@@ -81,6 +82,13 @@ namespace cryptonote
       return amount * ACCEPT_THRESHOLD;
     }
 
+    size_t get_max_template_weight(size_t median_weight, uint8_t version)
+    {
+      size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      return version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
+    }
+
     uint64_t get_transaction_weight_limit(uint8_t version)
     {
       if(version > 12)
@@ -110,7 +118,7 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0), m_template_journal_cookie(0)
   {
 
   }
@@ -252,14 +260,13 @@ namespace cryptonote
         memset(meta.padding, 0, sizeof(meta.padding));
         try
         {
-          if (kept_by_block)
-            m_parsed_tx_cache.insert(std::make_pair(id, tx));
           CRITICAL_REGION_LOCAL1(m_blockchain);
           LockedTXN lock(m_blockchain);
           m_blockchain.add_txpool_tx(id, blob, meta);
           if (!insert_key_images(tx, id, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)(tx_weight ? tx_weight : 1), receive_time), id);
+          m_pool_txs[id] = pool_tx_entry{meta, std::make_shared<transaction>(tx), blob.size()};
           lock.commit();
         }
         catch (const std::exception& e)
@@ -297,8 +304,6 @@ namespace cryptonote
 
       try
       {
-        if (kept_by_block)
-          m_parsed_tx_cache.insert(std::make_pair(id, tx));
         CRITICAL_REGION_LOCAL1(m_blockchain);
         LockedTXN lock(m_blockchain);
         m_blockchain.remove_txpool_tx(id);
@@ -306,6 +311,7 @@ namespace cryptonote
         if (!insert_key_images(tx, id, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)(tx_weight ? tx_weight : 1), receive_time), id);
+        m_pool_txs[id] = pool_tx_entry{meta, std::make_shared<transaction>(tx), blob.size()};
         lock.commit();
       }
       catch (const std::exception& e)
@@ -323,6 +329,8 @@ namespace cryptonote
     m_txpool_weight += tx_weight;
 
     ++m_cookie;
+    // after the bump, so an update from a template filled before this sees it
+    m_template_journal.push_back(std::make_pair(m_cookie.load(), id));
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
 
@@ -394,6 +402,7 @@ namespace cryptonote
         // remove first, in case this throws, so key images aren't removed
         MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
         m_blockchain.remove_txpool_tx(txid);
+        m_pool_txs.erase(txid);
         m_txpool_weight -= meta.weight;
         remove_transaction_keyimages(tx, txid);
         MINFO("Pruned tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
@@ -473,17 +482,17 @@ namespace cryptonote
     try
     {
       LockedTXN lock(m_blockchain);
-      txpool_tx_meta_t meta;
-      if(!m_blockchain.get_txpool_tx_meta(id, meta))
+      const auto ci = m_pool_txs.find(id);
+      if(ci == m_pool_txs.end())
       {
         MERROR("Failed to find tx in txpool");
         return false;
       }
+      const txpool_tx_meta_t meta = ci->second.meta;
       txblob = m_blockchain.get_txpool_tx_blob(id);
-      auto ci = m_parsed_tx_cache.find(id);
-      if(ci != m_parsed_tx_cache.end())
+      if(ci->second.tx)
       {
-        tx = ci->second;
+        tx = *ci->second.tx;
       }
       else if(!(meta.pruned ? parse_and_validate_tx_base_from_blob(txblob, tx) : parse_and_validate_tx_from_blob(txblob, tx)))
       {
@@ -503,6 +512,7 @@ namespace cryptonote
 
       // remove first, in case this throws, so key images aren't removed
       m_blockchain.remove_txpool_tx(id);
+      m_pool_txs.erase(ci);
       m_txpool_weight -= tx_weight;
       remove_transaction_keyimages(tx, id);
       lock.commit();
@@ -578,6 +588,7 @@ namespace cryptonote
           {
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
+            m_pool_txs.erase(txid);
             m_txpool_weight -= entry.second;
             remove_transaction_keyimages(tx, txid);
           }
@@ -642,8 +653,9 @@ namespace cryptonote
         if (m_blockchain.get_txpool_tx_meta(it->first, meta))
         {
           meta.relayed = true;
+          meta.do_not_relay = false;
           meta.last_relayed_time = now;
-          m_blockchain.update_txpool_tx(it->first, meta);
+          update_pool_tx_meta(it->first, meta);
         }
       }
       catch (const std::exception& e)
@@ -664,55 +676,49 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      transaction tx;
-      if(!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, tx) : parse_and_validate_tx_from_blob(*bd, tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
-      }
-      txs.push_back(tx);
-      return true;
-    }, true, include_unrelayed_txes);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    txs.reserve(snapshot->txs.size());
+    for (const pool_snapshot_tx &e: snapshot->txs)
+    {
+      if (!include_unrelayed_txes && e.meta.do_not_relay)
+        continue;
+      if (!e.tx)
+        continue;
+      txs.push_back(*e.tx);
+    }
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      txs.push_back(txid);
-      return true;
-    }, false, include_unrelayed_txes);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    txs.reserve(snapshot->txs.size());
+    for (const pool_snapshot_tx &e: snapshot->txs)
+      if (include_unrelayed_txes || !e.meta.do_not_relay)
+        txs.push_back(e.txid);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
     const uint64_t now = time(NULL);
-    backlog.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
-      return true;
-    }, false, include_unrelayed_txes);
+    backlog.reserve(snapshot->txs.size());
+    for (const pool_snapshot_tx &e: snapshot->txs)
+      if (include_unrelayed_txes || !e.meta.do_not_relay)
+        backlog.push_back({e.meta.weight, e.meta.fee, e.meta.receive_time - now});
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
     const uint64_t now = time(NULL);
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
     std::vector<uint32_t> weights;
-    weights.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    weights.reserve(snapshot->txs.size());
+    for (const pool_snapshot_tx &e: snapshot->txs)
+    {
+      const txpool_tx_meta_t &meta = e.meta;
+      if (!include_unrelayed_txes && meta.do_not_relay)
+        continue;
       weights.push_back(meta.weight);
       stats.bytes_total += meta.weight;
       if (!stats.bytes_min || meta.weight < stats.bytes_min)
@@ -733,8 +739,8 @@ namespace cryptonote
       agebytes[age].bytes += meta.weight;
       if (meta.double_spend_seen)
         ++stats.num_double_spends;
-      return true;
-      }, false, include_unrelayed_txes);
+    }
+    stats.txs_total = weights.size();
     stats.bytes_med = epee::misc_utils::median(weights);
     if (stats.txs_total > 1)
     {
@@ -857,21 +863,20 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool>& tx_infos, cryptonote::rpc::key_images_with_tx_hashes& key_image_infos) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    tx_infos.reserve(snapshot->txs.size());
+    key_image_infos.reserve(snapshot->key_images.size());
+    for (const pool_snapshot_tx &e: snapshot->txs)
+    {
+      const txpool_tx_meta_t &meta = e.meta;
+      if (meta.do_not_relay)
+        continue;
+      if (!e.tx)
+        continue;
       cryptonote::rpc::tx_in_pool txi;
-      txi.tx_hash = txid;
-      if(!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, txi.tx) : parse_and_validate_tx_from_blob(*bd, txi.tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
-      }
-      txi.tx.set_hash(txid);
-      txi.blob_size = bd->size();
+      txi.tx_hash = e.txid;
+      txi.tx = *e.tx;
+      txi.blob_size = e.blob_size;
       txi.weight = meta.weight;
       txi.fee = meta.fee;
       txi.kept_by_block = meta.kept_by_block;
@@ -885,20 +890,10 @@ namespace cryptonote
       txi.do_not_relay = meta.do_not_relay;
       txi.double_spend_seen = meta.double_spend_seen;
       tx_infos.push_back(txi);
-      return true;
-    }, true, false);
-
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      std::vector<crypto::hash> tx_hashes;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
-      for (const crypto::hash& tx_id_hash : kei_image_set)
-      {
-        tx_hashes.push_back(tx_id_hash);
-      }
-
-      const crypto::key_image& k_image = kee.first;
-      key_image_infos[k_image] = tx_hashes;
     }
+
+    for (const auto &kee: snapshot->key_images)
+      key_image_infos[kee.first] = kee.second;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -935,7 +930,8 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
-    m_parsed_tx_cache.clear();
+    m_template_journal.clear();
+    m_template_journal_cookie = m_cookie;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -943,7 +939,8 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
-    m_parsed_tx_cache.clear();
+    m_template_journal.clear();
+    m_template_journal_cookie = m_cookie;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1002,28 +999,78 @@ namespace cryptonote
     return ret;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const
+  void tx_memory_pool::update_pool_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta)
   {
-    struct transction_parser
+    m_blockchain.update_txpool_tx(txid, meta);
+    const auto i = m_pool_txs.find(txid);
+    if (i != m_pool_txs.end())
+      i->second.meta = meta;
+    invalidate_snapshot();
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::invalidate_snapshot() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+    m_snapshot.reset();
+  }
+  //---------------------------------------------------------------------------------
+  std::shared_ptr<const tx_memory_pool::pool_snapshot> tx_memory_pool::get_snapshot() const
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+      if (m_snapshot && m_snapshot->cookie == m_cookie)
+        return m_snapshot;
+    }
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    // another reader may have rebuilt it while we waited for the locks
     {
-      transction_parser(const cryptonote::blobdata &txblob, const crypto::hash &txid, transaction &tx): txblob(txblob), txid(txid), tx(tx), parsed(false) {}
-      cryptonote::transaction &operator()()
+      boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+      if (m_snapshot && m_snapshot->cookie == m_cookie)
+        return m_snapshot;
+    }
+
+    std::shared_ptr<pool_snapshot> snapshot = std::make_shared<pool_snapshot>();
+    snapshot->cookie = m_cookie;
+    snapshot->txs.reserve(m_pool_txs.size());
+    for (auto &e: m_pool_txs)
+    {
+      pool_tx_entry &entry = e.second;
+      if (!entry.tx)
       {
-        if (!parsed)
+        // txes loaded at startup are parsed on first use, and kept
+        std::shared_ptr<transaction> ptx = std::make_shared<transaction>();
+        try
         {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
-            throw std::runtime_error("failed to parse transaction blob");
-          tx.set_hash(txid);
-          parsed = true;
+          const cryptonote::blobdata blob = m_blockchain.get_txpool_tx_blob(e.first);
+          if (entry.meta.pruned ? parse_and_validate_tx_base_from_blob(blob, *ptx) : parse_and_validate_tx_from_blob(blob, *ptx))
+          {
+            ptx->set_hash(e.first);
+            entry.tx = ptx;
+          }
+          else
+            MERROR("Failed to parse tx from txpool");
+        }
+        catch (const std::exception &ex)
+        {
+          MERROR("Failed to get tx blob from txpool: " << ex.what());
         }
-        return tx;
       }
-      const cryptonote::blobdata &txblob;
-      const crypto::hash &txid;
-      transaction &tx;
-      bool parsed;
-    } lazy_tx(txblob, txid, tx);
+      snapshot->txs.push_back({e.first, entry.meta, entry.blob_size, entry.tx});
+    }
+    snapshot->key_images.reserve(m_spent_key_images.size());
+    for (const key_images_container::value_type& kee : m_spent_key_images)
+      snapshot->key_images.push_back(std::make_pair(kee.first, std::vector<crypto::hash>(kee.second.begin(), kee.second.end())));
 
+    boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+    m_snapshot = snapshot;
+    return m_snapshot;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, transaction &tx) const
+  {
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
     if(txd.max_used_block_id == null_hash)
@@ -1033,7 +1080,7 @@ namespace cryptonote
         return false;//we already sure that this tx is broken for this height
 
       tx_verification_context tvc;
-      if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+      if(!check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
       {
         txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
         txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1050,7 +1097,7 @@ namespace cryptonote
           return false;
         //check ring signature again, it is possible (with very small chance) that this transaction become again valid
         tx_verification_context tvc;
-        if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+        if(!check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
         {
           txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
           txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1059,7 +1106,7 @@ namespace cryptonote
       }
     }
     //if we here, transaction seems valid, but, anyway, check for key_images collisions with blockchain, just to be sure
-    if(m_blockchain.have_tx_keyimges_as_spent(lazy_tx()))
+    if(m_blockchain.have_tx_keyimges_as_spent(tx))
     {
       txd.double_spend_seen = true;
       return false;
@@ -1119,7 +1166,7 @@ namespace cryptonote
             changed = true;
             try
             {
-              m_blockchain.update_txpool_tx(txid, meta);
+              update_pool_tx_meta(txid, meta);
             }
             catch (const std::exception& e)
             {
@@ -1166,133 +1213,279 @@ namespace cryptonote
     return ss.str();
   }
   //---------------------------------------------------------------------------------
+  const transaction *tx_memory_pool::get_template_ready_tx(const crypto::hash &txid, pool_tx_entry &entry)
+  {
+    if (!entry.tx)
+    {
+      std::shared_ptr<transaction> ptx = std::make_shared<transaction>();
+      try
+      {
+        if (!parse_and_validate_tx_from_blob(m_blockchain.get_txpool_tx_blob(txid), *ptx))
+        {
+          MERROR("  failed to parse transaction blob");
+          return NULL;
+        }
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("  failed to get transaction blob: " << e.what());
+        return NULL;
+      }
+      ptx->set_hash(txid);
+      entry.tx = ptx;
+    }
+    else if (entry.tx.use_count() > 1)
+    {
+      // snapshot readers copy the tx without any lock, and checking its
+      // inputs expands it in place, so check a copy of our own instead
+      entry.tx = std::make_shared<transaction>(*entry.tx);
+    }
+
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images
+    txpool_tx_meta_t meta = entry.meta;
+    bool ready = false;
+    try
+    {
+      ready = is_transaction_ready_to_go(meta, txid, *entry.tx);
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Failed to check transaction readiness: " << e.what());
+      // continue, not fatal
+    }
+    if (memcmp(&entry.meta, &meta, sizeof(meta)))
+    {
+      try
+      {
+        update_pool_tx_meta(txid, meta);
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("Failed to update tx meta: " << e.what());
+        // continue, not fatal
+      }
+    }
+    if (!ready)
+    {
+      LOG_PRINT_L2("  not ready to go");
+      return NULL;
+    }
+    return entry.tx.get();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_block_template_tx(block &bl, std::unordered_set<crypto::key_image> &k_images, const crypto::hash &txid, size_t median_weight, uint64_t already_generated_coins, size_t max_total_weight, size_t &total_weight, uint64_t &fee, uint64_t &best_coinbase, uint8_t version)
+  {
+    const auto pool_it = m_pool_txs.find(txid);
+    if (pool_it == m_pool_txs.end())
+    {
+      MERROR("  failed to find tx meta");
+      return true;
+    }
+    txpool_tx_meta_t meta = pool_it->second.meta;
+    LOG_PRINT_L2("Considering " << txid << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+
+    if(meta.pruned)
+    {
+      LOG_PRINT_L2(" tx is pruned");
+      return true;
+    }
+
+    // Can not exceed maximum block weight
+    if (max_total_weight < total_weight + meta.weight)
+    {
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      return true;
+    }
+
+    uint64_t coinbase = 0;
+    // start using the optimal filling algorithm from v5
+    if (version >= 5)
+    {
+      // If we're getting lower coinbase tx,
+      // stop including more tx
+      uint64_t block_reward;
+      if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
+      {
+        LOG_PRINT_L2("  would exceed maximum block weight");
+        return true;
+      }
+      coinbase = block_reward + fee + meta.fee;
+      if (coinbase < template_accept_threshold(best_coinbase))
+      {
+        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        return true;
+      }
+    }
+    else
+    {
+      // If we've exceeded the penalty free weight,
+      // stop including more tx
+      if (total_weight > median_weight)
+      {
+        LOG_PRINT_L2("  would exceed median block weight");
+        return false;
+      }
+    }
+
+    const cryptonote::transaction *tx = get_template_ready_tx(txid, pool_it->second);
+    if (!tx)
+      return true;
+    if (have_key_images(k_images, *tx))
+    {
+      LOG_PRINT_L2("  key images already seen");
+      return true;
+    }
+
+    bl.tx_hashes.push_back(txid);
+    total_weight += meta.weight;
+    fee += meta.fee;
+    best_coinbase = coinbase;
+    append_key_images(k_images, *tx);
+    LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    uint64_t best_coinbase = 0, coinbase = 0;
+    uint64_t best_coinbase = 0;
     total_weight = 0;
     fee = 0;
 
     //baseline empty block
     get_block_reward(median_weight, total_weight, already_generated_coins, best_coinbase, version);
 
-
-    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
+    const size_t max_total_weight = get_max_template_weight(median_weight, version);
     std::unordered_set<crypto::key_image> k_images;
 
     LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
 
     LockedTXN lock(m_blockchain);
 
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    if (version >= 5)
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
-      {
-        MERROR("  failed to find tx meta");
-        continue;
-      }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
-
-      if(meta.pruned)
+      // gather what could go in, then let the selection weigh fees against the penalty
+      std::vector<template_candidate> candidates;
+      std::vector<crypto::hash> candidate_ids;
+      for (const auto &e: m_txs_by_fee_and_receive_time)
       {
-        LOG_PRINT_L2(" tx is pruned");
-        continue;
-      }
-
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
-
-      // start using the optimal filling algorithm from v5
-      if (version >= 5)
-      {
-        // If we're getting lower coinbase tx,
-        // stop including more tx
-        uint64_t block_reward;
-        if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
+        const auto pool_it = m_pool_txs.find(e.second);
+        if (pool_it == m_pool_txs.end())
         {
-          LOG_PRINT_L2("  would exceed maximum block weight");
+          MERROR("  failed to find tx meta");
           continue;
         }
-        coinbase = block_reward + fee + meta.fee;
-        if (coinbase < template_accept_threshold(best_coinbase))
-        {
-          LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        const txpool_tx_meta_t &meta = pool_it->second.meta;
+        if (meta.pruned || meta.weight > max_total_weight)
           continue;
-        }
-      }
-      else
-      {
-        // If we've exceeded the penalty free weight,
-        // stop including more tx
-        if (total_weight > median_weight)
+        const cryptonote::transaction *tx = get_template_ready_tx(e.second, pool_it->second);
+        if (!tx)
+          continue;
+        if (have_key_images(k_images, *tx))
         {
-          LOG_PRINT_L2("  would exceed median block weight");
-          break;
+          LOG_PRINT_L2("  key images already seen");
+          continue;
         }
+        append_key_images(k_images, *tx);
+        candidates.push_back({meta.weight, meta.fee});
+        candidate_ids.push_back(e.second);
       }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
-      try
-      {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
-      }
-      catch (const std::exception& e)
+      const block_reward_curve curve(median_weight, already_generated_coins, version);
+      std::vector<size_t> selected;
+      best_coinbase = select_template_txes(candidates, curve, max_total_weight, selected);
+      for (size_t i: selected)
       {
-        MERROR("Failed to check transaction readiness: " << e.what());
-        // continue, not fatal
+        bl.tx_hashes.push_back(candidate_ids[i]);
+        total_weight += candidates[i].weight;
+        fee += candidates[i].fee;
       }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
+    }
+    else
+    {
+      auto sorted_it = m_txs_by_fee_and_receive_time.begin();
+      for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
       {
-        try
-        {
-          m_blockchain.update_txpool_tx(sorted_it->second, meta);
-        }
-        catch (const std::exception& e)
-        {
-          MERROR("Failed to update tx meta: " << e.what());
-          // continue, not fatal
-        }
+        if (!add_block_template_tx(bl, k_images, sorted_it->second, median_weight, already_generated_coins, max_total_weight, total_weight, fee, best_coinbase, version))
+          break;
       }
-      if (!ready)
+    }
+    lock.commit();
+
+    expected_reward = best_coinbase;
+    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
+        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
+        << " (including " << print_money(fee) << " in fees)");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::update_block_template(block &bl, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    // the journal only goes back to the last block
+    if (pool_cookie < m_template_journal_cookie)
+      return false;
+
+    // drop what left the pool, and recount what's left
+    std::unordered_set<crypto::key_image> k_images;
+    std::vector<crypto::hash> tx_hashes;
+    tx_hashes.reserve(bl.tx_hashes.size());
+    total_weight = 0;
+    fee = 0;
+    for (const crypto::hash &txid: bl.tx_hashes)
+    {
+      const auto i = m_pool_txs.find(txid);
+      if (i == m_pool_txs.end() || !i->second.tx)
       {
-        LOG_PRINT_L2("  not ready to go");
+        LOG_PRINT_L2("Evicting " << txid << " from block template");
         continue;
       }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
+      tx_hashes.push_back(txid);
+      total_weight += i->second.meta.weight;
+      fee += i->second.meta.fee;
+      append_key_images(k_images, *i->second.tx);
+    }
+    bl.tx_hashes = std::move(tx_hashes);
+
+    uint64_t best_coinbase = 0;
+    get_block_reward(median_weight, total_weight, already_generated_coins, best_coinbase, version);
+    best_coinbase += fee;
+
+    // then offer the txes added since, best paying first, as a full pass would
+    std::vector<std::pair<double, crypto::hash>> added;
+    for (const auto &e: m_template_journal)
+    {
+      if (e.first <= pool_cookie)
         continue;
-      }
+      const auto i = m_pool_txs.find(e.second);
+      if (i == m_pool_txs.end())
+        continue;
+      added.push_back(std::make_pair(i->second.meta.fee / (double)(i->second.meta.weight ? i->second.meta.weight : 1), e.second));
+    }
+    std::sort(added.begin(), added.end(), [](const std::pair<double, crypto::hash> &a, const std::pair<double, crypto::hash> &b) { return a.first > b.first; });
 
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+    const size_t max_total_weight = get_max_template_weight(median_weight, version);
+    LOG_PRINT_L2("Updating block template, " << bl.tx_hashes.size() << " txes kept, " << added.size() << " new");
+
+    LockedTXN lock(m_blockchain);
+    for (const auto &e: added)
+    {
+      if (std::find(bl.tx_hashes.begin(), bl.tx_hashes.end(), e.second) != bl.tx_hashes.end())
+        continue;
+      if (!add_block_template_tx(bl, k_images, e.second, median_weight, already_generated_coins, max_total_weight, total_weight, fee, best_coinbase, version))
+        break;
     }
     lock.commit();
 
     expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
+    LOG_PRINT_L2("Block template updated with " << bl.tx_hashes.size() << " txes, weight "
         << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
         << " (including " << print_money(fee) << " in fees)");
     return true;
@@ -1336,6 +1529,7 @@ namespace cryptonote
           }
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
+          m_pool_txs.erase(txid);
           m_txpool_weight -= get_transaction_weight(tx, txblob.size());
           remove_transaction_keyimages(tx, txid);
           auto sorted_it = find_tx_in_sorted_container(txid);
@@ -1370,6 +1564,8 @@ namespace cryptonote
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
     m_spent_key_images.clear();
+    m_pool_txs.clear();
+    invalidate_snapshot();
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
@@ -1394,6 +1590,8 @@ namespace cryptonote
           return false;
         }
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+        // parsed in full the first time a block template considers it
+        m_pool_txs[txid] = pool_tx_entry{meta, nullptr, bd->size()};
         m_txpool_weight += meta.weight;
         return true;
       }, true);
@@ -32,6 +32,7 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -49,6 +50,8 @@
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
 
+class tx_pool_snapshot;
+
 namespace cryptonote
 {
   class Blockchain;
@@ -233,6 +236,26 @@ namespace cryptonote
      */
     bool fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version);
 
+    /**
+     * @brief Brings a block template filled earlier up to date with the pool
+     *
+     * Transactions which left the pool are dropped, and the ones added since
+     * are offered in fee order, with the same rules as fill_block_template,
+     * without going through the whole pool again.
+     *
+     * @param bl the block template to update
+     * @param pool_cookie the pool cookie from before the template was filled
+     * @param median_weight the current median block weight
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param total_weight return-by-reference the total weight of the new block
+     * @param fee return-by-reference the total of fees from the included transactions
+     * @param expected_reward return-by-reference the total reward awarded to the miner finding this block, including transaction fees
+     * @param version hard fork version to use for consensus rules
+     *
+     * @return true if updated, false if the template needs filling from scratch
+     */
+    bool update_block_template(block &bl, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version);
+
     /**
      * @brief get a list of all transactions in the pool
      *
@@ -332,6 +355,9 @@ namespace cryptonote
     /**
      * @brief tell the pool that certain transactions were just relayed
      *
+     * Relayed here means broadcast, so this also clears do_not_relay,
+     * which keeps txes on a Dandelion++ stem out of sight until then.
+     *
      * @param txs the list of transactions (and their hashes)
      */
     void set_relayed(const std::vector<std::pair<crypto::hash, cryptonote::blobdata>>& txs);
@@ -513,12 +539,11 @@ namespace cryptonote
      *
      * @param txd the transaction to check (and info about it)
      * @param txid the txid of the transaction to check
-     * @param txblob the transaction blob to check
-     * @param tx the parsed transaction, if successful
+     * @param tx the parsed transaction
      *
      * @return true if the transaction is good to go, otherwise false
      */
-    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction&tx) const;
+    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, transaction &tx) const;
 
     /**
      * @brief mark all transactions double spending the one passed
@@ -576,6 +601,12 @@ private:
     //! cache/call Blockchain::check_tx_inputs results
     bool check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
 
+    //! considers a pool tx for a block template, returns false if no more should be
+    bool add_block_template_tx(block &bl, std::unordered_set<crypto::key_image> &k_images, const crypto::hash &txid, size_t median_weight, uint64_t already_generated_coins, size_t max_total_weight, size_t &total_weight, uint64_t &fee, uint64_t &best_coinbase, uint8_t version);
+
+    //! writes a pool tx's metadata to the db and to m_pool_txs
+    void update_pool_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+
     //! transactions which are unlikely to be included in blocks
     /*! These transactions are kept in RAM in case they *are* included
      *  in a block eventually, but this container is not saved to disk.
@@ -589,7 +620,61 @@ private:
 
     mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
 
-    std::unordered_map<crypto::hash, transaction> m_parsed_tx_cache;
+    //! a pool transaction's metadata, and the transaction once parsed
+    struct pool_tx_entry
+    {
+      txpool_tx_meta_t meta;
+      std::shared_ptr<transaction> tx; //!< never changed once a snapshot shares it
+      size_t blob_size;
+    };
+
+    //! in memory copy of the pool, the db is only its persistence layer
+    /*! Kept in step with every txpool write to the db, so the block
+     *  template is built without reading or parsing anything from it.
+     *  Mutable as readers building a snapshot parse txes into it too.
+     */
+    mutable std::unordered_map<crypto::hash, pool_tx_entry> m_pool_txs;
+
+    //! parses a pool tx if needed and checks it can go in a block, NULL if not
+    const transaction *get_template_ready_tx(const crypto::hash &txid, pool_tx_entry &entry);
+
+    //! txes added since the last block, with the pool cookie after each
+    std::vector<std::pair<uint64_t, crypto::hash>> m_template_journal;
+    uint64_t m_template_journal_cookie; //!< pool cookie when the journal was last cleared
+
+    //! what readers see of a pool tx
+    struct pool_snapshot_tx
+    {
+      crypto::hash txid;
+      txpool_tx_meta_t meta;
+      size_t blob_size;
+      std::shared_ptr<const transaction> tx; //!< NULL if it failed to parse
+    };
+
+    //! an immutable copy of the pool, shared by readers until the pool changes
+    struct pool_snapshot
+    {
+      uint64_t cookie;
+      std::vector<pool_snapshot_tx> txs;
+      std::vector<std::pair<crypto::key_image, std::vector<crypto::hash>>> key_images;
+    };
+
+    /**
+     * @brief gets a snapshot of the pool, rebuilding it if the pool changed
+     *
+     * Readers iterate the snapshot without holding the pool or blockchain
+     * locks, so RPC queries do not stall tx admission, and only a rebuild
+     * has to take them.
+     */
+    std::shared_ptr<const pool_snapshot> get_snapshot() const;
+
+    //! drops the snapshot after a change which does not bump the cookie
+    void invalidate_snapshot() const;
+
+    mutable boost::mutex m_snapshot_lock; //!< guards m_snapshot only
+    mutable std::shared_ptr<const pool_snapshot> m_snapshot;
+
+    friend class ::tx_pool_snapshot;
   };
 }
 
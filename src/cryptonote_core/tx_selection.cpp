@@ -0,0 +1,207 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "int-util.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "tx_selection.h"
+
+namespace
+{
+  // txes already taken before the penalty free weight which the knapsack may swap out
+  const size_t KNAPSACK_OVERLAP = 64;
+  // at most this many txes go through the knapsack, cheaper ones are not considered
+  const size_t KNAPSACK_MAX_TXES = 1024;
+  // the weight left for the knapsack is split in this many steps
+  const size_t KNAPSACK_BUCKETS = 1024;
+}
+
+namespace cryptonote
+{
+
+block_reward_curve::block_reward_curve(size_t median_weight, uint64_t already_generated_coins, uint8_t version)
+{
+  m_median_weight = std::max(median_weight, get_min_block_weight(version));
+  if (!get_block_reward(median_weight, 0, already_generated_coins, m_base_reward, version))
+    m_base_reward = 0;
+}
+
+bool block_reward_curve::get(size_t block_weight, uint64_t &reward) const
+{
+  if (block_weight <= m_median_weight)
+  {
+    reward = m_base_reward;
+    return true;
+  }
+  if (block_weight > 2 * m_median_weight)
+    return false;
+
+  // same arithmetic as get_block_reward, so the results match exactly
+  uint64_t product_hi;
+  uint64_t multiplicand = 2 * m_median_weight - block_weight;
+  multiplicand *= block_weight;
+  uint64_t product_lo = mul128(m_base_reward, multiplicand, &product_hi);
+
+  uint64_t reward_hi;
+  uint64_t reward_lo;
+  div128_32(product_hi, product_lo, static_cast<uint32_t>(m_median_weight), &reward_hi, &reward_lo);
+  div128_32(reward_hi, reward_lo, static_cast<uint32_t>(m_median_weight), &reward_hi, &reward_lo);
+  reward = reward_lo;
+  return true;
+}
+
+uint64_t select_template_txes_greedy(const std::vector<template_candidate> &candidates, const block_reward_curve &curve, size_t max_weight, std::vector<size_t> &selected)
+{
+  size_t total_weight = 0;
+  uint64_t fee = 0;
+  uint64_t best_coinbase = 0;
+  curve.get(0, best_coinbase);
+  selected.clear();
+  for (size_t i = 0; i < candidates.size(); ++i)
+  {
+    const template_candidate &c = candidates[i];
+    if (max_weight < total_weight + c.weight)
+      continue;
+    uint64_t block_reward;
+    if (!curve.get(total_weight + c.weight, block_reward))
+      continue;
+    const uint64_t coinbase = block_reward + fee + c.fee;
+    if (coinbase < best_coinbase)
+      continue;
+    selected.push_back(i);
+    total_weight += c.weight;
+    fee += c.fee;
+    best_coinbase = coinbase;
+  }
+  return best_coinbase;
+}
+
+uint64_t select_template_txes(const std::vector<template_candidate> &candidates, const block_reward_curve &curve, size_t max_weight, std::vector<size_t> &selected)
+{
+  std::vector<size_t> greedy;
+  const uint64_t greedy_revenue = select_template_txes_greedy(candidates, curve, max_weight, greedy);
+
+  // with no penalty, the best paying txes per weight are the ones to take, so
+  // the knapsack only runs when the block can, and the pool would, go past it
+  const size_t free_weight = curve.get_penalty_free_weight();
+  size_t end = 0, core_weight = 0;
+  while (end < candidates.size() && core_weight + candidates[end].weight <= free_weight)
+    core_weight += candidates[end++].weight;
+  if (max_weight <= free_weight || end == candidates.size())
+  {
+    selected = std::move(greedy);
+    return greedy_revenue;
+  }
+
+  const size_t core = end > KNAPSACK_OVERLAP ? end - KNAPSACK_OVERLAP : 0;
+  const size_t n = std::min(candidates.size(), core + KNAPSACK_MAX_TXES) - core;
+  uint64_t core_fee = 0;
+  core_weight = 0;
+  for (size_t i = 0; i < core; ++i)
+  {
+    core_weight += candidates[i].weight;
+    core_fee += candidates[i].fee;
+  }
+
+  // past the weight where the penalty for one more byte is more than the best
+  // fee per byte, nothing is worth adding, so the knapsack stops there
+  double best_density = 0;
+  for (size_t i = core; i < core + n; ++i)
+    best_density = std::max(best_density, candidates[i].fee / (double)std::max<size_t>(1, candidates[i].weight));
+  const double median = curve.get_penalty_free_weight();
+  const double useful_weight = median + best_density * median * median / (2.0 * std::max<uint64_t>(1, curve.get_base_reward()));
+  const size_t weight_limit = useful_weight < max_weight ? std::max(core_weight, (size_t)useful_weight) : max_weight;
+
+  // txes are rounded up to whole steps, so a set fitting in the steps fits in the block
+  const size_t capacity = weight_limit - core_weight;
+  const size_t step = std::max<size_t>(1, (capacity + KNAPSACK_BUCKETS - 1) / KNAPSACK_BUCKETS);
+  const size_t n_steps = capacity / step;
+  std::vector<uint64_t> dp_fee(n_steps + 1, 0);
+  std::vector<size_t> dp_weight(n_steps + 1, 0);
+  std::vector<bool> dp_valid(n_steps + 1, false);
+  std::vector<bool> take(n * (n_steps + 1), false);
+  dp_valid[0] = true;
+  for (size_t i = 0; i < n; ++i)
+  {
+    const template_candidate &c = candidates[core + i];
+    const size_t w = std::max<size_t>(1, (c.weight + step - 1) / step);
+    if (w > n_steps)
+      continue;
+    for (size_t s = n_steps; s >= w; --s)
+    {
+      if (!dp_valid[s - w])
+        continue;
+      const uint64_t f = dp_fee[s - w] + c.fee;
+      const size_t wt = dp_weight[s - w] + c.weight;
+      if (!dp_valid[s] || f > dp_fee[s] || (f == dp_fee[s] && wt < dp_weight[s]))
+      {
+        dp_valid[s] = true;
+        dp_fee[s] = f;
+        dp_weight[s] = wt;
+        take[i * (n_steps + 1) + s] = true;
+      }
+    }
+  }
+
+  // the fees in each step are weighed against the penalty for their weight
+  uint64_t best_revenue = 0;
+  size_t best_step = 0;
+  for (size_t s = 0; s <= n_steps; ++s)
+  {
+    uint64_t block_reward;
+    if (!dp_valid[s] || !curve.get(core_weight + dp_weight[s], block_reward))
+      continue;
+    const uint64_t revenue = block_reward + core_fee + dp_fee[s];
+    if (revenue > best_revenue)
+    {
+      best_revenue = revenue;
+      best_step = s;
+    }
+  }
+  if (best_revenue <= greedy_revenue)
+  {
+    selected = std::move(greedy);
+    return greedy_revenue;
+  }
+
+  selected.clear();
+  for (size_t i = 0; i < core; ++i)
+    selected.push_back(i);
+  const size_t first_chosen = selected.size();
+  for (size_t i = n; i-- > 0; )
+  {
+    if (!take[i * (n_steps + 1) + best_step])
+      continue;
+    selected.push_back(core + i);
+    best_step -= std::max<size_t>(1, (candidates[core + i].weight + step - 1) / step);
+  }
+  std::reverse(selected.begin() + first_chosen, selected.end());
+  return best_revenue;
+}
+
+}
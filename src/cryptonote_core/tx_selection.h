@@ -0,0 +1,103 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cryptonote
+{
+  /**
+   * @brief the block reward as a function of block weight, for a given median
+   *
+   * Gives the same results as get_block_reward, but works out the parts
+   * which only depend on the median weight and the emission once, so it is
+   * cheap to evaluate for many block weights.
+   */
+  class block_reward_curve
+  {
+  public:
+    block_reward_curve(size_t median_weight, uint64_t already_generated_coins, uint8_t version);
+
+    /**
+     * @brief gets the reward for a block of the given weight
+     *
+     * @return false if the block would be too big, true otherwise
+     */
+    bool get(size_t block_weight, uint64_t &reward) const;
+
+    //! the weight up to which there is no penalty
+    size_t get_penalty_free_weight() const { return m_median_weight; }
+
+    //! the reward for a block with no penalty
+    uint64_t get_base_reward() const { return m_base_reward; }
+
+  private:
+    uint64_t m_base_reward;
+    size_t m_median_weight;
+  };
+
+  //! a transaction which could go in a block template
+  struct template_candidate
+  {
+    size_t weight;
+    uint64_t fee;
+  };
+
+  /**
+   * @brief picks txes for a block template, best fee per weight first
+   *
+   * A tx is added if it fits and does not decrease the miner's revenue, as
+   * the pool always did.
+   *
+   * @param candidates the txes to choose from, by decreasing fee per weight,
+   *        none of them spending the same key images as another
+   * @param curve the block reward curve for the block
+   * @param max_weight the maximum total weight of the txes
+   * @param selected return-by-reference the indices of the chosen txes, in order
+   *
+   * @return the miner's revenue, block reward plus fees
+   */
+  uint64_t select_template_txes_greedy(const std::vector<template_candidate> &candidates, const block_reward_curve &curve, size_t max_weight, std::vector<size_t> &selected);
+
+  /**
+   * @brief picks txes for a block template, maximizing the miner's revenue
+   *
+   * Txes which fit below the median weight are taken best fee per weight
+   * first. If the block may grow past that point and the pool has more to
+   * offer, the txes around and past it are chosen by a knapsack over fee and
+   * weight, weighed against the penalty, so a few well paying txes are not
+   * crowded out by lots of small ones or the other way round. Otherwise this
+   * is the same as select_template_txes_greedy, and the result is never worse.
+   *
+   * @copydetails select_template_txes_greedy
+   */
+  uint64_t select_template_txes(const std::vector<template_candidate> &candidates, const block_reward_curve &curve, size_t max_weight, std::vector<size_t> &selected);
+}
@@ -372,6 +372,22 @@ bool block_queue::get_next_span(uint64_t &height, std::vector<cryptonote::block_
   return false;
 }
 
+bool block_queue::get_filled_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  for (const auto &span: blocks)
+  {
+    if (span.start_block_height > height)
+      break;
+    if (span.start_block_height == height && !span.blocks.empty())
+    {
+      bcel = span.blocks;
+      return true;
+    }
+  }
+  return false;
+}
+
 bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &filled, boost::posix_time::ptime &time) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
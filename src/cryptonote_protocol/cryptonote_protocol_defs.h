@@ -194,10 +194,12 @@ namespace cryptonote
     {
       std::vector<blobdata> txs;
       std::string _; // padding
+      bool dandelionpp_fluff; // false if the txes are on their stem
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(txs)
         KV_SERIALIZE(_)
+        KV_SERIALIZE_OPT(dandelionpp_fluff, true) // peers without Dandelion++ only fluff
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -37,6 +37,7 @@
 // developer rfree: this code is caller of our new network code, and is modded; e.g. for rate limiting
 
 #include <boost/interprocess/detail/atomic.hpp>
+#include <boost/uuid/nil_generator.hpp>
 #include <list>
 #include <ctime>
 
@@ -870,20 +871,27 @@ namespace cryptonote
       return 1;
     }
 
+    // txes on their stem are kept as do_not_relay, so they are neither
+    // rebroadcast nor shown to RPC clients until they are fluffed
+    const bool stem = !arg.dandelionpp_fluff && m_core.dandelionpp_enabled();
+    arg.dandelionpp_fluff = !stem;
+
     std::vector<cryptonote::blobdata> newtxs;
     newtxs.reserve(arg.txs.size());
     for (size_t i = 0; i < arg.txs.size(); ++i)
     {
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx({arg.txs[i], crypto::null_hash}, tvc, false, true, false);
+      m_core.handle_incoming_tx({arg.txs[i], crypto::null_hash}, tvc, false, true, stem);
       if(tvc.m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
         drop_connection(context, false, false);
         return 1;
       }
-      if(tvc.m_should_be_relayed)
+      if(stem ? tvc.m_added_to_pool : tvc.m_should_be_relayed)
         newtxs.push_back(std::move(arg.txs[i]));
+      else if(!stem && m_dandelionpp.remove_embargo(crypto::cn_fast_hash(arg.txs[i].data(), arg.txs[i].size())))
+        newtxs.push_back(std::move(arg.txs[i])); // we had it on its stem, it is public now
     }
     arg.txs = std::move(newtxs);
 
@@ -1311,6 +1319,13 @@ namespace cryptonote
             return 1;
           }
 
+          // get the next span going while this one is verified and committed
+          {
+            std::vector<cryptonote::block_complete_entry> next_blocks;
+            if (m_block_queue.get_filled_span(start_height + blocks.size(), next_blocks))
+              m_core.prefetch_incoming_blocks(start_height + blocks.size(), std::move(next_blocks));
+          }
+
           uint64_t block_process_time_full = 0, transactions_process_time_full = 0;
           size_t num_txs = 0, blockidx = 0;
           for(const block_complete_entry& block_entry: blocks)
@@ -1532,10 +1547,41 @@ skip:
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    m_dandelionpp_embargo_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::fluff_embargoed_txes, this, dandelionpp::clock::now()));
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::fluff_embargoed_txes(dandelionpp::clock::time_point now)
+  {
+    NOTIFY_NEW_TRANSACTIONS::request arg;
+    arg.txs = m_dandelionpp.take_expired_embargoes(now);
+    if (arg.txs.empty())
+      return true;
+
+    // nobody fluffed them, they may have been dropped somewhere down the stem
+    MDEBUG("Fluffing " << arg.txs.size() << " txes at the end of their embargo");
+    arg.dandelionpp_fluff = true;
+    cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+    relay_transactions(arg, fake_context);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  boost::uuids::uuid t_cryptonote_protocol_handler<t_core>::get_dandelionpp_stem(const cryptonote_connection_context& source)
+  {
+    std::vector<boost::uuids::uuid> out_peers;
+    m_p2p->for_each_connection([&out_peers](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (peer_id && !context.m_is_income && context.m_remote_address.get_zone() == epee::net_utils::zone::public_ &&
+          context.m_state == cryptonote_connection_context::state_normal && (support_flags & P2P_SUPPORT_FLAG_DANDELIONPP))
+        out_peers.push_back(context.m_connection_id);
+      return true;
+    });
+    return m_dandelionpp.get_stem(source.m_connection_id, out_peers, dandelionpp::clock::now());
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::kick_idle_peers()
   {
     MTRACE("Checking for idle peers...");
@@ -2392,12 +2438,28 @@ skip:
     if (hide_tx_broadcast)
       MDEBUG("Attempting to conceal origin of tx via anonymity network connection(s)");
 
-    // no check for success, so tell core they're relayed unconditionally
+    // txes not yet fluffed go to a single stem peer, unless there is none
+    // or we fluff the txes of others in this epoch
+    boost::uuids::uuid stem = boost::uuids::nil_uuid();
+    if (!arg.dandelionpp_fluff && !hide_tx_broadcast && m_core.dandelionpp_enabled())
+      stem = get_dandelionpp_stem(exclude_context);
+    arg.dandelionpp_fluff = stem.is_nil();
+
+    // no check for success, so tell core they're relayed unconditionally,
+    // except for stemmed ones, which stay hidden until fluffed
+    const dandelionpp::clock::time_point now = dandelionpp::clock::now();
     const bool pad_transactions = m_core.pad_transactions() || hide_tx_broadcast;
     size_t bytes = pad_transactions ? 9 /* header */ + 4 /* 1 + 'txs' */ + tools::get_varint_data(arg.txs.size()).size() : 0;
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
     {
-      m_core.on_transaction_relayed(*tx_blob_it);
+      const crypto::hash blob_hash = crypto::cn_fast_hash(tx_blob_it->data(), tx_blob_it->size());
+      if (arg.dandelionpp_fluff)
+      {
+        m_dandelionpp.remove_embargo(blob_hash);
+        m_core.on_transaction_relayed(*tx_blob_it);
+      }
+      else
+        m_dandelionpp.add_embargo(blob_hash, *tx_blob_it, now);
       if (pad_transactions)
         bytes += tools::get_varint_data(tx_blob_it->size()).size() + tx_blob_it->size();
     }
@@ -2426,16 +2488,21 @@ skip:
       // if the size of _ moved enough, we might lose byte in size encoding, we don't care
     }
     std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid> > connections;
-    m_p2p->for_each_connection([hide_tx_broadcast, &exclude_context, &connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    if (!arg.dandelionpp_fluff)
+      connections.push_back({epee::net_utils::zone::public_, stem});
+    else
     {
-      const epee::net_utils::zone current_zone = context.m_remote_address.get_zone();
-      const bool broadcast_to_peer = peer_id && (hide_tx_broadcast != bool(current_zone == epee::net_utils::zone::public_)) && exclude_context.m_connection_id != context.m_connection_id;
+      m_p2p->for_each_connection([hide_tx_broadcast, &exclude_context, &connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+      {
+        const epee::net_utils::zone current_zone = context.m_remote_address.get_zone();
+        const bool broadcast_to_peer = peer_id && (hide_tx_broadcast != bool(current_zone == epee::net_utils::zone::public_)) && exclude_context.m_connection_id != context.m_connection_id;
 
-      if (broadcast_to_peer)
-        connections.push_back({current_zone, context.m_connection_id});
+        if (broadcast_to_peer)
+          connections.push_back({current_zone, context.m_connection_id});
 
-      return true;
-    });
+        return true;
+      });
+    }
 
     if (connections.empty())
       MERROR("Transaction not relayed - no" << (hide_tx_broadcast ? " privacy": "") << " peers available");
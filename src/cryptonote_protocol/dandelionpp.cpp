@@ -0,0 +1,161 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <random>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/uuid/nil_generator.hpp>
+#include "crypto/crypto.h"
+#include "dandelionpp.h"
+
+namespace cryptonote
+{
+namespace dandelionpp
+{
+  router::router(size_t stems, unsigned fluff_probability, std::chrono::seconds min_epoch, std::chrono::seconds epoch_range, std::chrono::seconds embargo_average):
+    m_max_stems(stems),
+    m_fluff_probability(fluff_probability),
+    m_min_epoch(min_epoch),
+    m_epoch_range(epoch_range),
+    m_embargo_average(embargo_average),
+    m_epoch_end(),
+    m_fluff(false)
+  {
+  }
+  //---------------------------------------------------------------------------------
+  void router::start_epoch(const std::vector<boost::uuids::uuid> &out_peers, clock::time_point now)
+  {
+    m_epoch_end = now + m_min_epoch + std::chrono::seconds(crypto::rand_range<uint64_t>(0, m_epoch_range.count()));
+    m_fluff = crypto::rand_idx<unsigned>(100) < m_fluff_probability;
+    m_stems.clear();
+    m_routes.clear();
+    replace_stems(out_peers);
+  }
+  //---------------------------------------------------------------------------------
+  void router::replace_stems(const std::vector<boost::uuids::uuid> &out_peers)
+  {
+    // drop the stems we lost, with the routes through them
+    for (auto i = m_stems.begin(); i != m_stems.end(); )
+    {
+      if (std::find(out_peers.begin(), out_peers.end(), *i) != out_peers.end())
+      {
+        ++i;
+        continue;
+      }
+      for (auto r = m_routes.begin(); r != m_routes.end(); )
+      {
+        if (r->second == *i)
+          r = m_routes.erase(r);
+        else
+          ++r;
+      }
+      i = m_stems.erase(i);
+    }
+
+    // and pick new ones at random from the other peers
+    std::vector<boost::uuids::uuid> candidates;
+    for (const boost::uuids::uuid &peer: out_peers)
+      if (std::find(m_stems.begin(), m_stems.end(), peer) == m_stems.end())
+        candidates.push_back(peer);
+    while (m_stems.size() < m_max_stems && !candidates.empty())
+    {
+      const size_t idx = crypto::rand_idx(candidates.size());
+      m_stems.push_back(candidates[idx]);
+      candidates[idx] = candidates.back();
+      candidates.pop_back();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  boost::uuids::uuid router::get_stem(const boost::uuids::uuid &source, const std::vector<boost::uuids::uuid> &out_peers, clock::time_point now)
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    if (now >= m_epoch_end)
+      start_epoch(out_peers, now);
+    else
+      replace_stems(out_peers);
+
+    // our own txes always go on a stem, even in a fluff epoch
+    if (m_fluff && !source.is_nil())
+      return boost::uuids::nil_uuid();
+
+    const auto i = m_routes.find(source);
+    if (i != m_routes.end())
+      return i->second;
+
+    std::vector<boost::uuids::uuid> choices;
+    for (const boost::uuids::uuid &stem: m_stems)
+      if (stem != source)
+        choices.push_back(stem);
+    if (choices.empty())
+      return boost::uuids::nil_uuid();
+    const boost::uuids::uuid stem = choices[crypto::rand_idx(choices.size())];
+    m_routes[source] = stem;
+    return stem;
+  }
+  //---------------------------------------------------------------------------------
+  bool router::add_embargo(const crypto::hash &id, const blobdata &blob, clock::time_point now)
+  {
+    // exponential, so the time a node waits tells nothing of its place on the stem
+    crypto::random_device rd;
+    std::exponential_distribution<double> dis(1.0 / m_embargo_average.count());
+    const clock::duration delay = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(dis(rd)));
+
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return m_embargoes.emplace(id, std::make_pair(now + delay, blob)).second;
+  }
+  //---------------------------------------------------------------------------------
+  bool router::remove_embargo(const crypto::hash &id)
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return m_embargoes.erase(id) > 0;
+  }
+  //---------------------------------------------------------------------------------
+  std::vector<blobdata> router::take_expired_embargoes(clock::time_point now)
+  {
+    std::vector<blobdata> expired;
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    for (auto i = m_embargoes.begin(); i != m_embargoes.end(); )
+    {
+      if (i->second.first <= now)
+      {
+        expired.push_back(std::move(i->second.second));
+        i = m_embargoes.erase(i);
+      }
+      else
+        ++i;
+    }
+    return expired;
+  }
+  //---------------------------------------------------------------------------------
+  size_t router::get_embargo_count() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return m_embargoes.size();
+  }
+}
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+#include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "cryptonote_config.h"
+
+namespace cryptonote
+{
+namespace dandelionpp
+{
+  typedef std::chrono::steady_clock clock;
+
+  /**
+   * @brief Dandelion++ relay state
+   *
+   * A new tx first travels along a stem, being passed to a single peer
+   * at each hop, before a node fluffs (floods) it, so its origin is hard
+   * to tell from where it was first seen broadcast. For each epoch, a
+   * node picks a few outgoing peers as stems, maps each source of txes
+   * to one of them, and decides whether it fluffs the txes it is sent
+   * rather than passing them along. Each tx a node stems is embargoed:
+   * if it was not seen fluffed when the embargo ends, the node fluffs it
+   * itself, so a tx dropped on the stem is not lost.
+   */
+  class router
+  {
+  public:
+    router(size_t stems = DANDELIONPP_STEMS, unsigned fluff_probability = DANDELIONPP_FLUFF_PROBABILITY,
+        std::chrono::seconds min_epoch = std::chrono::seconds(DANDELIONPP_MIN_EPOCH),
+        std::chrono::seconds epoch_range = std::chrono::seconds(DANDELIONPP_EPOCH_RANGE),
+        std::chrono::seconds embargo_average = std::chrono::seconds(DANDELIONPP_EMBARGO_AVERAGE));
+
+    /**
+     * @brief gets the peer to pass a tx to on its stem
+     *
+     * @param source the connection the tx came from, nil for our own txes
+     * @param out_peers the outgoing connections which may be stems
+     * @param now the current time
+     *
+     * @return the stem for txes from that source, nil if they are to be fluffed
+     */
+    boost::uuids::uuid get_stem(const boost::uuids::uuid &source, const std::vector<boost::uuids::uuid> &out_peers, clock::time_point now);
+
+    /**
+     * @brief starts the embargo of a tx we pass along a stem
+     *
+     * @return false if the tx was already embargoed
+     */
+    bool add_embargo(const crypto::hash &id, const blobdata &blob, clock::time_point now);
+
+    /**
+     * @brief ends the embargo of a tx which is being fluffed
+     *
+     * @return false if the tx was not embargoed
+     */
+    bool remove_embargo(const crypto::hash &id);
+
+    //! takes the txes whose embargo ended, for the caller to fluff
+    std::vector<blobdata> take_expired_embargoes(clock::time_point now);
+
+    size_t get_embargo_count() const;
+
+  private:
+    void start_epoch(const std::vector<boost::uuids::uuid> &out_peers, clock::time_point now);
+    void replace_stems(const std::vector<boost::uuids::uuid> &out_peers);
+
+  private:
+    mutable boost::mutex m_lock;
+
+    const size_t m_max_stems;
+    const unsigned m_fluff_probability;
+    const std::chrono::seconds m_min_epoch;
+    const std::chrono::seconds m_epoch_range;
+    const std::chrono::seconds m_embargo_average;
+
+    clock::time_point m_epoch_end;
+    bool m_fluff;
+    std::vector<boost::uuids::uuid> m_stems;
+    std::map<boost::uuids::uuid, boost::uuids::uuid> m_routes; //!< source -> stem, for this epoch
+    std::unordered_map<crypto::hash, std::pair<clock::time_point, blobdata>> m_embargoes;
+  };
+}
+}
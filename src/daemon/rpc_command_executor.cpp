@@ -2090,6 +2090,7 @@ bool t_rpc_command_executor::sync_info()
     tools::success_msg_writer() << "Downloading at " << current_download << " Kbps";
     if (res.next_needed_pruning_seed)
       tools::success_msg_writer() << "Next needed pruning seed: " << res.next_needed_pruning_seed;
+    tools::success_msg_writer() << "Last DB commit: " << res.db_commit_latency_us / 1e3 << " ms, last flush: " << res.db_flush_latency_us / 1e3 << " ms";
 
     tools::success_msg_writer() << std::to_string(res.peers.size()) << " peers";
     for (const auto &p: res.peers)
@@ -140,6 +140,18 @@ namespace hw {
         /*                               SUB ADDRESS                               */
         /* ======================================================================= */
         virtual bool  derive_subaddress_public_key(const crypto::public_key &pub, const crypto::key_derivation &derivation, const std::size_t output_index,  crypto::public_key &derived_pub) = 0;
+        virtual bool  derive_subaddress_public_keys(const std::vector<crypto::public_key> &pubs, const std::vector<crypto::key_derivation> &derivations, const std::vector<std::size_t> &output_indices, std::vector<crypto::public_key> &derived_pubs, std::vector<bool> &valid)
+        {
+            bool r = true;
+            derived_pubs.resize(pubs.size());
+            valid.resize(pubs.size());
+            for (size_t i = 0; i < pubs.size(); ++i)
+            {
+                valid[i] = derive_subaddress_public_key(pubs[i], derivations[i], output_indices[i], derived_pubs[i]);
+                r &= valid[i];
+            }
+            return r;
+        }
         virtual crypto::public_key  get_subaddress_spend_public_key(const cryptonote::account_keys& keys, const cryptonote::subaddress_index& index) = 0;
         virtual std::vector<crypto::public_key>  get_subaddress_spend_public_keys(const cryptonote::account_keys &keys, uint32_t account, uint32_t begin, uint32_t end) = 0;
         virtual cryptonote::account_public_address  get_subaddress(const cryptonote::account_keys& keys, const cryptonote::subaddress_index &index) = 0;
@@ -154,6 +166,18 @@ namespace hw {
         virtual bool  sc_secret_add( crypto::secret_key &r, const crypto::secret_key &a, const crypto::secret_key &b) = 0;
         virtual crypto::secret_key  generate_keys(crypto::public_key &pub, crypto::secret_key &sec, const crypto::secret_key& recovery_key = crypto::secret_key(), bool recover = false) = 0;
         virtual bool  generate_key_derivation(const crypto::public_key &pub, const crypto::secret_key &sec, crypto::key_derivation &derivation) = 0;
+        virtual bool  generate_key_derivations(const std::vector<crypto::public_key> &pubs, const crypto::secret_key &sec, std::vector<crypto::key_derivation> &derivations, std::vector<bool> &valid)
+        {
+            bool r = true;
+            derivations.resize(pubs.size());
+            valid.resize(pubs.size());
+            for (size_t i = 0; i < pubs.size(); ++i)
+            {
+                valid[i] = generate_key_derivation(pubs[i], sec, derivations[i]);
+                r &= valid[i];
+            }
+            return r;
+        }
         virtual bool  conceal_derivation(crypto::key_derivation &derivation, const crypto::public_key &tx_pub_key, const std::vector<crypto::public_key> &additional_tx_pub_keys, const crypto::key_derivation &main_derivation, const std::vector<crypto::key_derivation> &additional_derivations) = 0;
         virtual bool  derivation_to_scalar(const crypto::key_derivation &derivation, const size_t output_index, crypto::ec_scalar &res) = 0;
         virtual bool  derive_secret_key(const crypto::key_derivation &derivation, const std::size_t output_index, const crypto::secret_key &sec,  crypto::secret_key &derived_sec) = 0;
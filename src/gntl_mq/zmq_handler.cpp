@@ -357,6 +357,7 @@ namespace gntlMQ
 
     cryptonote::NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
+    r.dandelionpp_fluff = false;
     m_core.get_protocol()->relay_transactions(r, fake_context);
 
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
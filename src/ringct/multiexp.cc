@@ -36,6 +36,7 @@ extern "C"
 #include "crypto/crypto-ops.h"
 }
 #include "common/aligned.h"
+#include "common/threadpool.h"
 #include "rctOps.h"
 #include "multiexp.h"
 
@@ -45,6 +46,9 @@ extern "C"
 //#define MULTIEXP_PERF(x) x
 #define MULTIEXP_PERF(x)
 
+// below this, threading pippenger costs more than it saves
+#define PIPPENGER_MT_MIN_POINTS 512
+
 #define RAW_MEMORY_BLOCK
 //#define ALTERNATE_LAYOUT
 //#define TRACK_STRAUS_ZERO_IDENTITY
@@ -606,34 +610,15 @@ size_t pippenger_get_cache_size(const std::shared_ptr<pippenger_cached_data> &ca
   return cache->size * sizeof(*cache->cached);
 }
 
-rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache, size_t cache_size, size_t c)
+// accumulates windows [k_begin, k_end) into result, ie result = sum of W_k * 2^(c*(k-k_begin))
+static void pippenger_windows(const std::vector<MultiexpData> &data, const pippenger_cached_data *cache, const pippenger_cached_data *cache_2, size_t cache_size, size_t c, size_t k_begin, size_t k_end, ge_p3 &result, bool &result_init)
 {
-  if (cache != NULL && cache_size == 0)
-    cache_size = cache->size;
-  CHECK_AND_ASSERT_THROW_MES(cache == NULL || cache_size <= cache->size, "Cache is too small");
-  if (c == 0)
-    c = get_pippenger_c(data.size());
-  CHECK_AND_ASSERT_THROW_MES(c <= 9, "c is too large");
-
-  ge_p3 result = ge_p3_identity;
-  bool result_init = false;
   std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
   bool buckets_init[1<<9];
-  std::shared_ptr<pippenger_cached_data> local_cache = cache == NULL ? pippenger_init_cache(data) : cache;
-  std::shared_ptr<pippenger_cached_data> local_cache_2 = data.size() > cache_size ? pippenger_init_cache(data, cache_size) : NULL;
-
-  rct::key maxscalar = rct::zero();
-  for (size_t i = 0; i < data.size(); ++i)
-  {
-    if (maxscalar < data[i].scalar)
-      maxscalar = data[i].scalar;
-  }
-  size_t groups = 0;
-  while (groups < 256 && !(maxscalar < pow2(groups)))
-    ++groups;
-  groups = (groups + c - 1) / c;
 
-  for (size_t k = groups; k-- > 0; )
+  result = ge_p3_identity;
+  result_init = false;
+  for (size_t k = k_end; k-- > k_begin; )
   {
     if (result_init)
     {
@@ -664,9 +649,9 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
       if (buckets_init[bucket])
       {
         if (i < cache_size)
-          add(buckets[bucket], local_cache->cached[i]);
+          add(buckets[bucket], cache->cached[i]);
         else
-          add(buckets[bucket], local_cache_2->cached[i - cache_size]);
+          add(buckets[bucket], cache_2->cached[i - cache_size]);
       }
       else
       {
@@ -702,6 +687,99 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
       }
     }
   }
+}
+
+size_t get_pippenger_threads(size_t N)
+{
+  if (N < PIPPENGER_MT_MIN_POINTS)
+    return 1;
+  return tools::threadpool::getInstance().get_max_concurrency();
+}
+
+rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache, size_t cache_size, size_t c, size_t threads)
+{
+  if (cache != NULL && cache_size == 0)
+    cache_size = cache->size;
+  CHECK_AND_ASSERT_THROW_MES(cache == NULL || cache_size <= cache->size, "Cache is too small");
+  if (c == 0)
+    c = get_pippenger_c(data.size());
+  CHECK_AND_ASSERT_THROW_MES(c <= 9, "c is too large");
+  if (threads == 0)
+    threads = get_pippenger_threads(data.size());
+
+  std::shared_ptr<pippenger_cached_data> local_cache = cache == NULL ? pippenger_init_cache(data) : cache;
+  std::shared_ptr<pippenger_cached_data> local_cache_2 = data.size() > cache_size ? pippenger_init_cache(data, cache_size) : NULL;
+
+  rct::key maxscalar = rct::zero();
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    if (maxscalar < data[i].scalar)
+      maxscalar = data[i].scalar;
+  }
+  size_t groups = 0;
+  while (groups < 256 && !(maxscalar < pow2(groups)))
+    ++groups;
+  groups = (groups + c - 1) / c;
+
+  ge_p3 result = ge_p3_identity;
+  bool result_init = false;
+  if (threads > groups)
+    threads = groups;
+  if (threads <= 1)
+  {
+    pippenger_windows(data, local_cache.get(), local_cache_2.get(), cache_size, c, 0, groups, result, result_init);
+  }
+  else
+  {
+    // each thread gets a contiguous range of windows, and the partial sums are
+    // then combined from the top, shifting by the width of the range below
+    std::vector<size_t> k_begin(threads + 1);
+    for (size_t t = 0; t <= threads; ++t)
+      k_begin[t] = groups * t / threads;
+    std::vector<ge_p3> partial(threads);
+    std::vector<uint8_t> partial_init(threads, 0);
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    for (size_t t = 0; t < threads; ++t)
+    {
+      tpool.submit(&waiter, [&, t] {
+        bool init;
+        pippenger_windows(data, local_cache.get(), local_cache_2.get(), cache_size, c, k_begin[t], k_begin[t + 1], partial[t], init);
+        partial_init[t] = init;
+      }, true);
+    }
+    waiter.wait(&tpool);
+
+    for (size_t t = threads; t-- > 0; )
+    {
+      if (result_init)
+      {
+        ge_p2 p2;
+        ge_p3_to_p2(&p2, &result);
+        const size_t doublings = c * (k_begin[t + 1] - k_begin[t]);
+        for (size_t i = 0; i < doublings; ++i)
+        {
+          ge_p1p1 p1;
+          ge_p2_dbl(&p1, &p2);
+          if (i == doublings - 1)
+            ge_p1p1_to_p3(&result, &p1);
+          else
+            ge_p1p1_to_p2(&p2, &p1);
+        }
+      }
+      if (partial_init[t])
+      {
+        if (result_init)
+          add(result, partial[t]);
+        else
+        {
+          result = partial[t];
+          result_init = true;
+        }
+      }
+    }
+  }
 
   rct::key res;
   ge_p3_tobytes(res.bytes, &result);
@@ -1340,44 +1340,99 @@ namespace rct {
       return verRctSemanticsSimple(std::vector<const rctSig*>(1, &rv));
     }
 
+    static void verRctSemanticsSimpleBisect(const std::vector<const rctSig*> & rvv, size_t begin, size_t end, std::vector<bool> & valid)
+    {
+      if (begin == end)
+        return;
+      if (verRctSemanticsSimple(std::vector<const rctSig*>(rvv.begin() + begin, rvv.begin() + end)))
+      {
+        std::fill(valid.begin() + begin, valid.begin() + end, true);
+        return;
+      }
+      if (end - begin == 1)
+        return;
+      const size_t mid = begin + (end - begin) / 2;
+      verRctSemanticsSimpleBisect(rvv, begin, mid, valid);
+      verRctSemanticsSimpleBisect(rvv, mid, end, valid);
+    }
+
+    //verifies the semantics of a set of transactions in one batch, and if
+    //that fails, bisects it to find out which of them are bad
+    std::vector<bool> verRctSemanticsSimpleEach(const std::vector<const rctSig*> & rvv)
+    {
+      std::vector<bool> valid(rvv.size(), false);
+      if (rvv.empty())
+        return valid;
+      if (verRctSemanticsSimple(rvv))
+      {
+        std::fill(valid.begin(), valid.end(), true);
+        return valid;
+      }
+      LOG_PRINT_L1("One transaction among this batch has bad semantics, bisecting");
+      const size_t mid = rvv.size() / 2;
+      verRctSemanticsSimpleBisect(rvv, 0, mid, valid);
+      verRctSemanticsSimpleBisect(rvv, mid, rvv.size(), valid);
+      return valid;
+    }
+
     //ver RingCT simple
     //assumes only post-rct style inputs (at least for max anonymity)
-    bool verRctNonSemanticsSimple(const rctSig & rv) {
+    //verifies the MG signatures of all inputs of a set of transactions, eg all
+    //the transactions of a block. Work is split per input rather than per
+    //transaction, so one large transaction does not hold up a set of small ones
+    bool verRctNonSemanticsSimple(const std::vector<const rctSig*> & rvv) {
       try
       {
         PERF_TIMER(verRctNonSemanticsSimple);
 
-        CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof || rv.type == RCTTypeSimpleBulletproof, false, "verRctNonSemanticsSimple called on non simple rctSig");
-        const bool bulletproof = is_rct_bulletproof(rv.type);
-        // semantics check is early, and mixRing/MGs aren't resolved yet
-        if(bulletproof)
-          CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
-        else
-          CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
-
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
+        size_t n_inputs = 0;
+        for (const rctSig *rvp: rvv)
+        {
+          CHECK_AND_ASSERT_MES(rvp, false, "rctSig pointer is NULL");
+          const rctSig &rv = *rvp;
+          CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof || rv.type == RCTTypeSimpleBulletproof, false, "verRctNonSemanticsSimple called on non simple rctSig");
+          const bool bulletproof = is_rct_bulletproof(rv.type);
+          // semantics check is early, and mixRing/MGs aren't resolved yet
+          if(bulletproof)
+            CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
+          else
+            CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
+          CHECK_AND_ASSERT_MES(rv.p.MGs.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.MGs and mixRing");
+          n_inputs += rv.mixRing.size();
+        }
 
-        std::deque<bool> results(threads);
         tools::threadpool& tpool = tools::threadpool::getInstance();
         tools::threadpool::waiter waiter;
 
-        const keyV &pseudoOuts = bulletproof ? rv.p.pseudoOuts : rv.pseudoOuts;
-
-        const key message = get_pre_mlsag_hash(rv, hw::get_device("default"));
-
-        results.clear();
-        results.resize(rv.mixRing.size());
-        for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
-          tpool.submit(&waiter, [&, i] {
-              results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+        // the message hashes all the range proofs, so those are worth threading too
+        std::vector<key> messages(rvv.size());
+        for (size_t n = 0; n < rvv.size(); ++n) {
+          tpool.submit(&waiter, [&, n] {
+              messages[n] = get_pre_mlsag_hash(*rvv[n], hw::get_device("default"));
           });
         }
         waiter.wait(&tpool);
 
-        for (size_t i = 0; i < results.size(); ++i) {
-          if(!results[i]) {
-            LOG_PRINT_L1("verRctMGSimple failed for input " << i);
-            return false;
+        std::deque<bool> results(n_inputs);
+        size_t idx = 0;
+        for (size_t n = 0; n < rvv.size(); ++n) {
+          const rctSig &rv = *rvv[n];
+          const keyV &pseudoOuts = is_rct_bulletproof(rv.type) ? rv.p.pseudoOuts : rv.pseudoOuts;
+          for (size_t i = 0 ; i < rv.mixRing.size() ; i++, idx++) {
+            tpool.submit(&waiter, [&, n, i, idx] {
+                results[idx] = verRctMGSimple(messages[n], rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+            });
+          }
+        }
+        waiter.wait(&tpool);
+
+        idx = 0;
+        for (size_t n = 0; n < rvv.size(); ++n) {
+          for (size_t i = 0; i < rvv[n]->mixRing.size(); ++i, ++idx) {
+            if(!results[idx]) {
+              LOG_PRINT_L1("verRctMGSimple failed for input " << i << " of rctSig " << n);
+              return false;
+            }
           }
         }
 
@@ -1396,6 +1451,11 @@ namespace rct {
       }
     }
 
+    bool verRctNonSemanticsSimple(const rctSig & rv)
+    {
+      return verRctNonSemanticsSimple(std::vector<const rctSig*>(1, &rv));
+    }
+
     //RingCT protocol
     //genRct:
     //   creates an rctSig with all data necessary to verify the rangeProofs and that the signer owns one of the
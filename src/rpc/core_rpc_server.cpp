@@ -360,6 +360,10 @@ namespace cryptonote
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
     res.version = GNTL_VERSION_FULL;
+    if (restricted)
+      res.output_cache_hits = res.output_cache_misses = 0;
+    else
+      m_core.get_blockchain_storage().get_db().get_output_cache_stats(res.output_cache_hits, res.output_cache_misses);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -426,6 +430,8 @@ namespace cryptonote
       }
     }
 
+    // blocks and their output indices come from the same snapshot, without the blockchain lock
+    db_snapshot snapshot(&m_core.get_blockchain_storage().get_db());
     std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> bs;
     if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, max_blocks))
     {
@@ -1031,6 +1037,7 @@ namespace cryptonote
 
     NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
+    r.dandelionpp_fluff = false;
     m_core.get_protocol()->relay_transactions(r, fake_context);
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
     res.status = CORE_RPC_STATUS_OK;
@@ -2584,6 +2591,7 @@ namespace cryptonote
         cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
         NOTIFY_NEW_TRANSACTIONS::request r;
         r.txs.push_back(txblob);
+        r.dandelionpp_fluff = false;
         m_core.get_protocol()->relay_transactions(r, fake_context);
         //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
       }
@@ -2630,6 +2638,7 @@ namespace cryptonote
       return true;
     });
     res.overview = block_queue.get_overview(res.height);
+    m_core.get_blockchain_storage().get_db().get_commit_latency(res.db_commit_latency_us, res.db_flush_latency_us);
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -89,7 +89,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 3
+#define CORE_RPC_VERSION_MINOR 5
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -724,6 +724,8 @@ namespace cryptonote
       uint64_t database_size;
       bool update_available;
       std::string version;
+      uint64_t output_cache_hits;
+      uint64_t output_cache_misses;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_response_base)
@@ -758,6 +760,8 @@ namespace cryptonote
         KV_SERIALIZE(database_size)
         KV_SERIALIZE(update_available)
         KV_SERIALIZE(version)
+        KV_SERIALIZE_OPT(output_cache_hits, (uint64_t)0)
+        KV_SERIALIZE_OPT(output_cache_misses, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -2244,6 +2248,8 @@ struct request_t: public rpc_access_request_base
       std::list<peer> peers;
       std::list<span> spans;
       std::string overview;
+      uint64_t db_commit_latency_us;
+      uint64_t db_flush_latency_us;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_response_base)
@@ -2253,6 +2259,8 @@ struct request_t: public rpc_access_request_base
         KV_SERIALIZE(peers)
         KV_SERIALIZE(spans)
         KV_SERIALIZE(overview)
+        KV_SERIALIZE_OPT(db_commit_latency_us, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_flush_latency_us, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -0,0 +1,180 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <array>
+#include <unordered_map>
+#include "cache_log.h"
+
+#define CACHE_CHUNK_MIN_SIZE 2048
+#define CACHE_CHUNK_MAX_SIZE 65536
+#define CACHE_CHUNK_MASK (((uint64_t)0x1fff) << 51) // 8 kB average past the minimum
+
+namespace
+{
+  // random values indexed by byte for the gear rolling hash, generated
+  // with splitmix64 so they are stable across runs
+  struct gear_table
+  {
+    std::array<uint64_t, 256> table;
+    gear_table()
+    {
+      uint64_t state = 0x6765617274626c65;
+      for (uint64_t &v: table)
+      {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        v = z ^ (z >> 31);
+      }
+    }
+  };
+  const gear_table gear;
+
+  crypto::hash chunk_hash(const char *data, size_t size)
+  {
+    return crypto::cn_fast_hash(data, size);
+  }
+}
+
+namespace tools
+{
+
+std::vector<std::pair<size_t, size_t>> wallet_cache_log::split(const std::string &stream)
+{
+  std::vector<std::pair<size_t, size_t>> chunks;
+  const unsigned char *data = reinterpret_cast<const unsigned char*>(stream.data());
+  const size_t size = stream.size();
+  size_t start = 0;
+  while (start < size)
+  {
+    const size_t end = std::min<size_t>(start + CACHE_CHUNK_MAX_SIZE, size);
+    size_t pos = std::min<size_t>(start + CACHE_CHUNK_MIN_SIZE, end);
+    uint64_t h = 0;
+    for (; pos < end; ++pos)
+    {
+      h = (h << 1) + gear.table[data[pos]];
+      if ((h & CACHE_CHUNK_MASK) == 0)
+      {
+        ++pos;
+        break;
+      }
+    }
+    chunks.push_back(std::make_pair(start, pos - start));
+    start = pos;
+  }
+  return chunks;
+}
+
+void wallet_cache_log::clear()
+{
+  m_persisted.clear();
+  m_base_hash = crypto::null_hash;
+  m_stream_hash = crypto::null_hash;
+}
+
+void wallet_cache_log::reset(const std::string &stream)
+{
+  clear();
+  for (const auto &c: split(stream))
+    m_persisted.insert(chunk_hash(stream.data() + c.first, c.second));
+  m_stream_hash = chunk_hash(stream.data(), stream.size());
+  m_base_hash = m_stream_hash;
+}
+
+bool wallet_cache_log::make_record(const std::string &stream, record &rec) const
+{
+  rec.base_hash = m_base_hash;
+  rec.stream_hash = chunk_hash(stream.data(), stream.size());
+  rec.manifest.clear();
+  rec.chunks.clear();
+  if (rec.stream_hash == m_stream_hash)
+    return false;
+
+  std::unordered_set<crypto::hash> added;
+  for (const auto &c: split(stream))
+  {
+    const crypto::hash h = chunk_hash(stream.data() + c.first, c.second);
+    rec.manifest.push_back(h);
+    if (m_persisted.find(h) == m_persisted.end() && added.insert(h).second)
+      rec.chunks.emplace_back(stream, c.first, c.second);
+  }
+  return true;
+}
+
+void wallet_cache_log::commit(const record &rec)
+{
+  m_persisted.insert(rec.manifest.begin(), rec.manifest.end());
+  m_stream_hash = rec.stream_hash;
+}
+
+size_t wallet_cache_log::replay(const std::string &base, const std::vector<record> &records, std::string &stream)
+{
+  std::unordered_map<crypto::hash, std::pair<const char*, size_t>> chunks;
+  clear();
+  for (const auto &c: split(base))
+  {
+    const crypto::hash h = chunk_hash(base.data() + c.first, c.second);
+    chunks.emplace(h, std::make_pair(base.data() + c.first, c.second));
+    m_persisted.insert(h);
+  }
+  m_stream_hash = chunk_hash(base.data(), base.size());
+  m_base_hash = m_stream_hash;
+  stream = base;
+
+  size_t applied = 0;
+  std::string candidate;
+  for (const record &rec: records)
+  {
+    if (rec.base_hash != m_base_hash)
+      break;
+    for (const std::string &c: rec.chunks)
+      chunks.emplace(chunk_hash(c.data(), c.size()), std::make_pair(c.data(), c.size()));
+
+    bool complete = true;
+    candidate.clear();
+    for (const crypto::hash &h: rec.manifest)
+    {
+      const auto i = chunks.find(h);
+      if (i == chunks.end())
+      {
+        complete = false;
+        break;
+      }
+      candidate.append(i->second.first, i->second.second);
+    }
+    if (!complete || chunk_hash(candidate.data(), candidate.size()) != rec.stream_hash)
+      break;
+
+    stream.swap(candidate);
+    commit(rec);
+    ++applied;
+  }
+  return applied;
+}
+
+}
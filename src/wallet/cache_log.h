@@ -0,0 +1,95 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "serialization/serialization.h"
+#include "serialization/vector.h"
+#include "serialization/crypto.h"
+#include "serialization/string.h"
+
+namespace tools
+{
+  // Incremental storage for the serialized wallet cache. The cache stream is
+  // cut into content defined chunks, so an edit only changes the chunks around
+  // it even when it shifts everything after it. Each store then appends a
+  // record with the chunk list of the new stream and the chunks not persisted
+  // yet, on top of the last full cache file.
+  class wallet_cache_log
+  {
+  public:
+    struct record
+    {
+      crypto::hash base_hash;
+      crypto::hash stream_hash;
+      std::vector<crypto::hash> manifest;
+      std::vector<std::string> chunks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(base_hash)
+        FIELD(stream_hash)
+        FIELD(manifest)
+        FIELD(chunks)
+      END_SERIALIZE()
+    };
+
+    // returns the (offset, size) of each chunk of stream
+    static std::vector<std::pair<size_t, size_t>> split(const std::string &stream);
+
+    // forgets all state, the next store will need to be a full one
+    void clear();
+    bool empty() const { return m_persisted.empty(); }
+
+    // stream has just been written in full
+    void reset(const std::string &stream);
+
+    // fills rec with what needs appending for stream to be recoverable,
+    // returns false if stream is the one last persisted
+    bool make_record(const std::string &stream, record &rec) const;
+
+    // rec has been appended
+    void commit(const record &rec);
+
+    // rebuilds the latest stream from the full cache and the records that
+    // followed it, stopping at the first record which does not check out or
+    // was written on top of another full cache;
+    // returns the number of records applied, and resets the state to match
+    size_t replay(const std::string &base, const std::vector<record> &records, std::string &stream);
+
+  private:
+    std::unordered_set<crypto::hash> m_persisted;
+    crypto::hash m_base_hash;
+    crypto::hash m_stream_hash;
+  };
+}
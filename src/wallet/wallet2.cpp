@@ -133,6 +133,10 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY 1024
 
+#define CACHE_LOG_MAX_RATIO 0.5 // rewrite the whole cache once the delta log grows past this fraction of it
+
+#define KEY_DERIVATION_BATCH_SIZE 64 // tx pubkeys per batched derivation task
+
 #define GAMMA_SHAPE 19.28
 #define GAMMA_SCALE (1/1.61)
 
@@ -1087,7 +1091,10 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_key_device_type(hw::device::device_type::SOFTWARE),
   m_ring_history_saved(false),
   m_ringdb(),
+  m_history_loaded(true),
   m_last_block_reward(0),
+  m_cache_base_size(0),
+  m_cache_log_size(0),
   m_encrypt_keys_after_refresh(boost::none),
   m_unattended(unattended),
   m_offline(false),
@@ -2147,7 +2154,10 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
+      {
+        load_history();
         m_payments.emplace(payment_id, payment);
+      }
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
   }
@@ -2168,6 +2178,7 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
   auto unconf_it = m_unconfirmed_txs.find(txid);
   if(unconf_it != m_unconfirmed_txs.end()) {
     if (store_tx_info()) {
+      load_history();
       try {
         m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
       }
@@ -2182,6 +2193,7 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::transaction &tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
 {
+  load_history();
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
   // fill with the info we know, some info might already be there
   if (entry.second)
@@ -2387,42 +2399,109 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   hwdev.set_mode(hw::device::TRANSACTION_PARSE);
   const cryptonote::account_keys &keys = m_account.get_keys();
 
-  auto gender = [&](wallet2::is_out_data &iod) {
-    boost::unique_lock<hw::device> hwdev_lock(hwdev);
-    if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
+  std::vector<wallet2::is_out_data*> iods;
+  for (auto &slot: tx_cache_data)
+  {
+    for (auto &iod: slot.primary)
+      iods.push_back(&iod);
+    for (auto &iod: slot.additional)
+      iods.push_back(&iod);
+  }
+
+  auto gender = [&](size_t begin, size_t end) {
+    std::vector<crypto::public_key> pkeys;
+    std::vector<crypto::key_derivation> derivations;
+    std::vector<bool> valid;
+    pkeys.reserve(end - begin);
+    for (size_t n = begin; n < end; ++n)
+      pkeys.push_back(iods[n]->pkey);
     {
-      MWARNING("Failed to generate key derivation from tx pubkey, skipping");
-      static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
-      memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+      boost::unique_lock<hw::device> hwdev_lock(hwdev);
+      hwdev.generate_key_derivations(pkeys, keys.m_view_secret_key, derivations, valid);
+    }
+    for (size_t n = begin; n < end; ++n)
+    {
+      wallet2::is_out_data &iod = *iods[n];
+      if (valid[n - begin])
+      {
+        iod.derivation = derivations[n - begin];
+      }
+      else
+      {
+        MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+        static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+        memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+      }
     }
   };
 
-  for (auto &slot: tx_cache_data)
+  for (size_t begin = 0; begin < iods.size(); begin += KEY_DERIVATION_BATCH_SIZE)
   {
-    for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
-    for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+    const size_t end = std::min<size_t>(begin + KEY_DERIVATION_BATCH_SIZE, iods.size());
+    tpool.submit(&waiter, [&gender, begin, end]() { gender(begin, end); }, true);
   }
   waiter.wait(&tpool);
 
   auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
+    std::vector<size_t> outs;
+    std::vector<crypto::public_key> out_keys;
     for (size_t k = 0; k < n_vouts; ++k)
     {
       const auto &o = tx.vout[k];
       if (o.target.type() == typeid(cryptonote::txout_to_key))
       {
-        std::vector<crypto::key_derivation> additional_derivations;
-        for (const auto &iod: tx_cache_data[txidx].additional)
-          additional_derivations.push_back(iod.derivation);
-        const auto &key = boost::get<txout_to_key>(o.target).key;
-        for (size_t l = 0; l < tx_cache_data[txidx].primary.size(); ++l)
+        outs.push_back(k);
+        out_keys.push_back(boost::get<txout_to_key>(o.target).key);
+      }
+    }
+    if (outs.empty())
+      return;
+
+    std::vector<crypto::key_derivation> derivations(outs.size());
+    std::vector<crypto::public_key> spend_keys;
+    std::vector<bool> valid;
+    for (size_t l = 0; l < tx_cache_data[txidx].primary.size(); ++l)
+    {
+      auto &primary = tx_cache_data[txidx].primary[l];
+      THROW_WALLET_EXCEPTION_IF(primary.received.size() != n_vouts,
+          error::wallet_internal_error, "Unexpected received array size");
+
+      // try the shared tx pubkey
+      std::fill(derivations.begin(), derivations.end(), primary.derivation);
+      hwdev.derive_subaddress_public_keys(out_keys, derivations, outs, spend_keys, valid);
+      for (size_t n = 0; n < outs.size(); ++n)
+      {
+        auto found = m_subaddresses.find(spend_keys[n]);
+        if (found != m_subaddresses.end())
+          primary.received[outs[n]] = subaddress_receive_info{ found->second, primary.derivation };
+      }
+
+      // try additional tx pubkeys if available, only alongside the first tx pubkey
+      if (l > 0 || tx_cache_data[txidx].additional.empty())
+        continue;
+      const auto &additional = tx_cache_data[txidx].additional;
+      std::vector<size_t> additional_outs;
+      std::vector<crypto::public_key> additional_out_keys;
+      std::vector<crypto::key_derivation> additional_derivations;
+      for (size_t n = 0; n < outs.size(); ++n)
+      {
+        if (primary.received[outs[n]])
+          continue;
+        if (outs[n] >= additional.size())
         {
-          THROW_WALLET_EXCEPTION_IF(tx_cache_data[txidx].primary[l].received.size() != n_vouts,
-              error::wallet_internal_error, "Unexpected received array size");
-          tx_cache_data[txidx].primary[l].received[k] = is_out_to_acc_precomp(m_subaddresses, key, tx_cache_data[txidx].primary[l].derivation, additional_derivations, k, hwdev);
-          additional_derivations.clear();
+          MERROR("wrong number of additional derivations");
+          continue;
         }
+        additional_outs.push_back(outs[n]);
+        additional_out_keys.push_back(out_keys[n]);
+        additional_derivations.push_back(additional[outs[n]].derivation);
+      }
+      hwdev.derive_subaddress_public_keys(additional_out_keys, additional_derivations, additional_outs, spend_keys, valid);
+      for (size_t n = 0; n < additional_outs.size(); ++n)
+      {
+        auto found = m_subaddresses.find(spend_keys[n]);
+        if (found != m_subaddresses.end())
+          primary.received[additional_outs[n]] = subaddress_receive_info{ found->second, additional_derivations[n] };
       }
     }
   };
@@ -3245,6 +3324,7 @@ void wallet2::detach_blockchain(uint64_t height)
   size_t blocks_detached = m_blockchain.size() - height;
   m_blockchain.crop(height);
 
+  load_history();
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
@@ -3282,6 +3362,8 @@ bool wallet2::clear()
   m_tx_keys.clear();
   m_additional_tx_keys.clear();
   m_confirmed_txs.clear();
+  m_history_blob.clear();
+  m_history_loaded = true;
   m_unconfirmed_payments.clear();
   m_scanned_pool_txs[0].clear();
   m_scanned_pool_txs[1].clear();
@@ -3302,6 +3384,8 @@ void wallet2::clear_soft(bool keep_key_images)
   m_unconfirmed_txs.clear();
   m_payments.clear();
   m_confirmed_txs.clear();
+  m_history_blob.clear();
+  m_history_loaded = true;
   m_unconfirmed_payments.clear();
   m_scanned_pool_txs[0].clear();
   m_scanned_pool_txs[1].clear();
@@ -3523,6 +3607,10 @@ void wallet2::setup_keys(const epee::wipeable_string &password)
   cache_key_data[HASH_SIZE] = CACHE_KEY_TAIL;
   cn_fast_hash(cache_key_data.data(), HASH_SIZE+1, (crypto::hash&)m_cache_key);
   get_ringdb_key();
+
+  // the delta log and the cache it applies to are encrypted with the old key,
+  // so the next store must write the whole cache again
+  m_cache_log.clear();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::change_password(const std::string &filename, const epee::wipeable_string &original_password, const epee::wipeable_string &new_password)
@@ -4980,6 +5068,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
     std::string buf;
     bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf, std::numeric_limits<size_t>::max());
     THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
+    m_cache_base_size = buf.size();
 
     // try to read it as an encrypted cache
     try
@@ -4993,6 +5082,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cache_data[0]);
 
       try {
+        load_cache_log(cache_data);
         std::stringstream iss;
         iss << cache_data;
         boost::archive::portable_binary_iarchive ar(iss);
@@ -5000,6 +5090,9 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       }
       catch(...)
       {
+        // older caches are rewritten in full on the next store
+        m_cache_log.clear();
+
         // try with previous scheme: direct from keys
         crypto::chacha_key key;
         generate_chacha_key_from_secret_keys(key);
@@ -5036,6 +5129,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
     catch (...)
     {
       LOG_PRINT_L1("Failed to load encrypted cache, trying unencrypted");
+      m_cache_log.clear();
       try {
         std::stringstream iss;
         iss << buf;
@@ -5135,6 +5229,31 @@ void wallet2::trim_hashchain()
   }
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::load_history() const
+{
+  if (m_history_loaded)
+    return;
+  PERF_TIMER(load_history);
+  std::stringstream iss;
+  iss << m_history_blob;
+  boost::archive::portable_binary_iarchive ar(iss);
+  ar >> m_payments;
+  ar >> m_confirmed_txs;
+  m_history_blob = std::string();
+  m_history_loaded = true;
+}
+//----------------------------------------------------------------------------------------------------
+std::string wallet2::get_history_blob() const
+{
+  if (!m_history_loaded)
+    return m_history_blob;
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  ar << m_payments;
+  ar << m_confirmed_txs;
+  return oss.str();
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::check_genesis(const crypto::hash& genesis_hash) const {
   std::string what("Genesis block mismatch. You probably use wallet without testnet (or stagenet) flag with blockchain from test (or stage) network or vice versa");
 
@@ -5189,9 +5308,14 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
   std::stringstream oss;
   boost::archive::portable_binary_oarchive ar(oss);
   ar << *this;
+  const std::string cache_data = oss.str();
+
+  // append what changed since the last store if the delta log is not due for compaction
+  if (same_file && store_cache_log(cache_data))
+    return;
 
   wallet2::cache_file_data cache_file_data = {};
-  cache_file_data.cache_data = oss.str();
+  cache_file_data.cache_data = cache_data;
   std::string cipher;
   cipher.resize(cache_file_data.cache_data.size());
   cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
@@ -5231,6 +5355,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_address_file);
     }
+    // remove old cache delta log
+    boost::system::error_code ec;
+    boost::filesystem::remove(old_file + ".delta", ec);
+    m_cache_log.clear();
   } else {
     // save to new file
 #ifdef WIN32
@@ -5255,7 +5383,104 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the new cache supersedes the delta log, whose records refer to the old one
+    boost::system::error_code ec;
+    boost::filesystem::remove(get_cache_log_file(), ec);
+    if (ec)
+      MWARNING("Failed to remove " << get_cache_log_file() << ": " << ec.message());
+    m_cache_log.reset(cache_data);
+    m_cache_base_size = boost::filesystem::file_size(m_wallet_file, ec);
+    m_cache_log_size = 0;
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_log(std::string &cache_data)
+{
+  m_cache_log_size = 0;
+  const std::string log_file = get_cache_log_file();
+  boost::system::error_code e;
+  if (!boost::filesystem::exists(log_file, e) || e)
+  {
+    m_cache_log.reset(cache_data);
+    return;
+  }
+
+  std::string buf;
+  if (!epee::file_io_utils::load_file_to_string(log_file, buf, std::numeric_limits<size_t>::max()))
+  {
+    MERROR("Failed to read " << log_file << ", ignoring it");
+    m_cache_log.clear();
+    return;
+  }
+
+  std::vector<wallet_cache_log::record> records;
+  std::istringstream iss(buf);
+  binary_archive<false> ar(iss);
+  while (ar.remaining_bytes() > 0)
+  {
+    wallet2::cache_file_data cache_file_data;
+    if (!::serialization::serialize(ar, cache_file_data))
+      break;
+    std::string record_data;
+    record_data.resize(cache_file_data.cache_data.size());
+    crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &record_data[0]);
+    wallet_cache_log::record record;
+    if (!::serialization::parse_binary(record_data, record))
+      break;
+    records.push_back(std::move(record));
+  }
+
+  std::string stream;
+  const size_t applied = m_cache_log.replay(cache_data, records, stream);
+  if (applied < records.size() || !iss.good() || ar.remaining_bytes() > 0)
+  {
+    // never append after a bad record, the next store will write the whole cache
+    MWARNING("Ignoring unusable records at the end of " << log_file << ", " << applied << " applied");
+    m_cache_log.clear();
+  }
+  else
+  {
+    m_cache_log_size = buf.size();
   }
+  LOG_PRINT_L1("Applied " << applied << " cache delta records");
+  cache_data.swap(stream);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_cache_log(const std::string &cache_data)
+{
+  if (m_cache_log.empty())
+    return false;
+  boost::system::error_code e;
+  if (!boost::filesystem::exists(m_wallet_file, e) || e)
+    return false;
+
+  wallet_cache_log::record record;
+  if (!m_cache_log.make_record(cache_data, record))
+    return true; // nothing changed since the last store
+
+  std::string record_data;
+  THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(record, record_data), error::wallet_internal_error, "Failed to serialize cache delta record");
+  wallet2::cache_file_data cache_file_data = {};
+  cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
+  cache_file_data.cache_data.resize(record_data.size());
+  crypto::chacha20(record_data.data(), record_data.size(), m_cache_key, cache_file_data.iv, &cache_file_data.cache_data[0]);
+  std::string blob;
+  THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(cache_file_data, blob), error::wallet_internal_error, "Failed to serialize cache delta record");
+
+  if (m_cache_log_size + blob.size() > m_cache_base_size * CACHE_LOG_MAX_RATIO)
+    return false;
+
+  const std::string log_file = get_cache_log_file();
+  if (!epee::file_io_utils::append_string_to_file(log_file, blob))
+  {
+    // a partial record may have been written, nothing may follow it
+    m_cache_log.clear();
+    THROW_WALLET_EXCEPTION(error::file_save_error, log_file);
+  }
+  m_cache_log.commit(record);
+  m_cache_log_size += blob.size();
+  return true;
 }
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance(uint32_t index_major, bool strict) const
@@ -5381,6 +5606,7 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_history();
   auto range = m_payments.equal_range(payment_id);
   std::for_each(range.first, range.second, [&payments, &min_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height &&
@@ -5394,6 +5620,7 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_history();
   auto range = std::make_pair(m_payments.begin(), m_payments.end());
   std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
@@ -5408,6 +5635,7 @@ void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_det
 void wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
     uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_history();
   for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i) {
     if (i->second.m_block_height <= min_height || i->second.m_block_height > max_height)
       continue;
@@ -6819,6 +7047,7 @@ bool wallet2::get_ring(const crypto::chacha_key &key, const crypto::key_image &k
 
 bool wallet2::get_rings(const crypto::hash &txid, std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &outs)
 {
+  load_history();
   for (auto i: m_confirmed_txs)
   {
     if (txid == i.first)
@@ -8308,6 +8537,7 @@ static uint32_t get_count_above(const std::vector<wallet2::transfer_details> &tr
 
 bool wallet2::light_wallet_login(bool &new_address)
 {
+  load_history();
   MDEBUG("Light wallet login request");
   m_light_wallet_connected = false;
   tools::COMMAND_RPC_LOGIN::request request;
@@ -8523,6 +8753,7 @@ bool wallet2::light_wallet_get_address_info(tools::COMMAND_RPC_GET_ADDRESS_INFO:
 
 void wallet2::light_wallet_get_address_txs()
 {
+  load_history();
   MDEBUG("Refreshing light wallet");
 
   tools::COMMAND_RPC_GET_ADDRESS_TXS::request ireq;
@@ -11239,6 +11470,7 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, size_t offset, uint64_t &spent, uint64_t &unspent, bool check_spent)
 {
+  load_history();
   PERF_TIMER(import_key_images_lots);
   COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
   COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
@@ -11518,6 +11750,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 }
 wallet2::payment_container wallet2::export_payments() const
 {
+  load_history();
   payment_container payments;
   for (auto const &p : m_payments)
   {
@@ -11527,6 +11760,7 @@ wallet2::payment_container wallet2::export_payments() const
 }
 void wallet2::import_payments(const payment_container &payments)
 {
+  load_history();
   m_payments.clear();
   for (auto const &p : payments)
   {
@@ -11535,6 +11769,7 @@ void wallet2::import_payments(const payment_container &payments)
 }
 void wallet2::import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments)
 {
+  load_history();
   m_confirmed_txs.clear();
   for (auto const &p : confirmed_payments)
   {
@@ -38,6 +38,7 @@
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/deque.hpp>
+#include <boost/mpl/bool.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <atomic>
 #include <random>
@@ -62,6 +63,7 @@
 #include "wallet_errors.h"
 #include "common/password.h"
 #include "node_rpc_proxy.h"
+#include "cache_log.h"
 #include "wallet_light_rpc.h"
 #include "wallet_rpc_helpers.h"
 
@@ -79,6 +81,7 @@
   THROW_ON_RPC_RESPONSE_ERROR(r, err, res, method, tools::error::wallet_generic_rpc_error, method, res.status)
 
 class Serialization_portability_wallet_Test;
+class Serialization_portability_wallet_history_Test;
 
 namespace tools
 {
@@ -192,6 +195,7 @@ private:
   class wallet2
   {
     friend class ::Serialization_portability_wallet_Test;
+    friend class ::Serialization_portability_wallet_history_Test;
     friend class wallet_keys_unlocker;
   public:
     static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
@@ -862,13 +866,15 @@ private:
       a & m_unconfirmed_txs;
       if(ver < 7)
         return;
-      a & m_payments;
+      if(ver < 27)
+        a & m_payments;
       if(ver < 8)
         return;
       a & m_tx_keys;
       if(ver < 9)
         return;
-      a & m_confirmed_txs;
+      if(ver < 27)
+        a & m_confirmed_txs;
       if(ver < 11)
         return;
       a & dummy_refresh_height;
@@ -942,6 +948,26 @@ private:
       if(ver < 26)
         return;
       a & m_rpc_client_secret_key;
+      if(ver < 27)
+        return;
+      serialize_history(a, typename t_archive::is_saving());
+    }
+
+    // m_payments and m_confirmed_txs are kept serialized on their own, and
+    // only deserialized when first needed
+    template <class t_archive>
+    void serialize_history(t_archive &a, boost::mpl::true_)
+    {
+      std::string history = get_history_blob();
+      a & history;
+    }
+    template <class t_archive>
+    void serialize_history(t_archive &a, boost::mpl::false_)
+    {
+      a & m_history_blob;
+      m_payments.clear();
+      m_confirmed_txs.clear();
+      m_history_loaded = false;
     }
 
     /*!
@@ -1336,6 +1362,11 @@ private:
     std::vector<size_t> get_only_rct(const std::vector<size_t> &unused_dust_indices, const std::vector<size_t> &unused_transfers_indices) const;
     void scan_output(const cryptonote::transaction &tx, bool miner_tx, const crypto::public_key &tx_pub_key, size_t i, tx_scan_info_t &tx_scan_info, int &num_vouts_received, std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_money_got_in_outs, std::vector<size_t> &outs, bool pool);
     void trim_hashchain();
+    void load_history() const;
+    std::string get_history_blob() const;
+    std::string get_cache_log_file() const { return m_wallet_file + ".delta"; }
+    void load_cache_log(std::string &cache_data);
+    bool store_cache_log(const std::string &cache_data);
     crypto::key_image get_multisig_composite_key_image(size_t n) const;
     rct::multisig_kLRki get_multisig_composite_kLRki(size_t n, const std::unordered_set<crypto::public_key> &ignore_set, std::unordered_set<rct::key> &used_L, std::unordered_set<rct::key> &new_used_L) const;
     rct::multisig_kLRki get_multisig_kLRki(size_t n, const rct::key &k) const;
@@ -1374,14 +1405,16 @@ private:
     epee::net_utils::http::http_simple_client m_http_client;
     hashchain m_blockchain;
     std::unordered_map<crypto::hash, unconfirmed_transfer_details> m_unconfirmed_txs;
-    std::unordered_map<crypto::hash, confirmed_transfer_details> m_confirmed_txs;
+    mutable std::unordered_map<crypto::hash, confirmed_transfer_details> m_confirmed_txs; // see load_history
     std::unordered_multimap<crypto::hash, pool_payment_details> m_unconfirmed_payments;
     std::unordered_map<crypto::hash, crypto::secret_key> m_tx_keys;
     cryptonote::checkpoints m_checkpoints;
     std::unordered_map<crypto::hash, std::vector<crypto::secret_key>> m_additional_tx_keys;
 
     transfer_container m_transfers;
-    payment_container m_payments;
+    mutable payment_container m_payments; // see load_history
+    mutable std::string m_history_blob;
+    mutable bool m_history_loaded;
     std::unordered_map<crypto::key_image, size_t> m_key_images;
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
@@ -1475,6 +1508,9 @@ private:
     std::unique_ptr<tools::file_locker> m_keys_file_locker;
 
     crypto::chacha_key m_cache_key;
+    wallet_cache_log m_cache_log;
+    uint64_t m_cache_base_size;
+    uint64_t m_cache_log_size;
     boost::optional<epee::wipeable_string> m_encrypt_keys_after_refresh;
 
     bool m_unattended;
@@ -1483,7 +1519,7 @@ private:
 
   };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 26)
+BOOST_CLASS_VERSION(tools::wallet2, 27)
 BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 11)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info::LR, 0)
@@ -40,6 +40,7 @@
 #include "integer_overflow.h"
 #include "ring_signature_1.h"
 #include "tx_validation.h"
+#include "txpool.h"
 #include "v2_tests.h"
 #include "rct.h"
 #include "multisig.h"
@@ -0,0 +1,109 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "chaingen.h"
+#include "txpool.h"
+
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  bool get_template(core &c, const account_base &miner, block &b)
+  {
+    difficulty_type diffic;
+    uint64_t height, expected_reward;
+    return c.get_block_template(b, miner.get_keys().m_account_address, diffic, height, expected_reward, blobdata());
+  }
+
+  bool has_tx(const block &b, const transaction &tx)
+  {
+    const crypto::hash txid = get_transaction_hash(tx);
+    return std::find(b.tx_hashes.begin(), b.tx_hashes.end(), txid) != b.tx_hashes.end();
+  }
+}
+
+////////
+// class txpool_template_update;
+
+txpool_template_update::txpool_template_update()
+{
+  REGISTER_CALLBACK_METHOD(txpool_template_update, fill_template);
+  REGISTER_CALLBACK_METHOD(txpool_template_update, check_template_updated);
+  m_template_miner.generate();
+}
+
+bool txpool_template_update::generate(std::vector<test_event_entry> &events) const
+{
+  uint64_t ts_start = 1338224400;
+
+  GENERATE_ACCOUNT(miner);
+  GENERATE_ACCOUNT(bob);
+
+  MAKE_GENESIS_BLOCK(events, blk_0, miner, ts_start);
+  MAKE_NEXT_BLOCK(events, blk_1, blk_0, bob);
+  REWIND_BLOCKS(events, blk_1r, blk_1, miner);
+  MAKE_TX(events, tx_0, miner, bob, MK_COINS(1), blk_0);
+  DO_CALLBACK(events, "fill_template");
+  // a single tx right after the fill, spending another output so both stay in the pool
+  MAKE_TX(events, tx_1, bob, miner, MK_COINS(1), blk_1);
+  DO_CALLBACK(events, "check_template_updated");
+
+  return true;
+}
+
+bool txpool_template_update::fill_template(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry> &events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("txpool_template_update::fill_template");
+
+  const transaction &tx_0 = boost::get<transaction>(events[ev_index - 1]);
+  block b;
+  CHECK_TEST_CONDITION(get_template(c, m_template_miner, b));
+  CHECK_EQ(1, b.tx_hashes.size());
+  CHECK_TEST_CONDITION(has_tx(b, tx_0));
+
+  return true;
+}
+
+bool txpool_template_update::check_template_updated(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry> &events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("txpool_template_update::check_template_updated");
+
+  const transaction &tx_0 = boost::get<transaction>(events[ev_index - 3]);
+  const transaction &tx_1 = boost::get<transaction>(events[ev_index - 1]);
+  CHECK_EQ(2, c.get_pool_transactions_count());
+
+  // same miner and nonce, only the pool changed: this goes through update_block_template
+  block b;
+  CHECK_TEST_CONDITION(get_template(c, m_template_miner, b));
+  CHECK_EQ(2, b.tx_hashes.size());
+  CHECK_TEST_CONDITION(has_tx(b, tx_0));
+  CHECK_TEST_CONDITION(has_tx(b, tx_1));
+
+  return true;
+}
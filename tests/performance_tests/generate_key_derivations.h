@@ -0,0 +1,68 @@
+// Copyright (c) 2021-2024, The GNTL Project
+// Copyright (c) 2014-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/account.h"
+
+// N derivations with the same view secret key, as done when scanning a block
+// span; compare with N times test_generate_key_derivation
+template<size_t N>
+class test_generate_key_derivations
+{
+public:
+  static const size_t loop_count = N < 16 ? 1000 : 100;
+
+  bool init()
+  {
+    m_bob.generate();
+    m_tx_pub_keys.resize(N);
+    for (auto &pkey: m_tx_pub_keys)
+    {
+      crypto::secret_key skey;
+      crypto::generate_keys(pkey, skey);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<crypto::key_derivation> derivations;
+    std::vector<bool> valid;
+    return crypto::generate_key_derivations(m_tx_pub_keys, m_bob.get_keys().m_view_secret_key, derivations, valid);
+  }
+
+private:
+  cryptonote::account_base m_bob;
+  std::vector<crypto::public_key> m_tx_pub_keys;
+};
@@ -44,6 +44,7 @@
 #include "derive_secret_key.h"
 #include "ge_frombytes_vartime.h"
 #include "generate_key_derivation.h"
+#include "generate_key_derivations.h"
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
@@ -52,6 +53,8 @@
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
 #include "rct_mlsag.h"
+#include "rx_slow_hash.h"
+#include "template_selection.h"
 
 namespace po = boost::program_options;
 
@@ -149,6 +152,9 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE0(filter, test_is_out_to_acc_precomp);
   TEST_PERFORMANCE0(filter, test_generate_key_image_helper);
   TEST_PERFORMANCE0(filter, test_generate_key_derivation);
+  TEST_PERFORMANCE1(filter, test_generate_key_derivations, 1);
+  TEST_PERFORMANCE1(filter, test_generate_key_derivations, 16);
+  TEST_PERFORMANCE1(filter, test_generate_key_derivations, 256);
   TEST_PERFORMANCE0(filter, test_generate_key_image);
   TEST_PERFORMANCE0(filter, test_derive_public_key);
   TEST_PERFORMANCE0(filter, test_derive_secret_key);
@@ -159,6 +165,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, test_wallet2_expand_subaddresses, 50, 200);
 
   TEST_PERFORMANCE0(filter, test_cn_slow_hash);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 0);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 1);
+
+  TEST_PERFORMANCE1(filter, test_template_selection, false);
+  TEST_PERFORMANCE1(filter, test_template_selection, true);
   TEST_PERFORMANCE1(filter, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, test_cn_fast_hash, 16384);
 
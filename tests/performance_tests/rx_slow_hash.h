@@ -0,0 +1,74 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+extern "C" void rx_stop_mining(void);
+
+// miners == 0 is the light mode used for verification, otherwise the full
+// dataset is used as when mining; run under "perf stat -e dTLB-load-misses"
+// with and without GNTL_RANDOMX_NUMA or huge pages to compare TLB misses
+template<int miners>
+class test_rx_slow_hash
+{
+public:
+  static const size_t loop_count = miners ? 1000 : 100;
+
+  ~test_rx_slow_hash()
+  {
+    crypto::rx_slow_hash_free_state();
+    if (miners)
+      rx_stop_mining();
+  }
+
+  bool init()
+  {
+    crypto::rand(sizeof(m_data), (uint8_t*)m_data);
+    crypto::rand(sizeof(m_seed), (uint8_t*)m_seed);
+    // the VM is kept per thread, so start from one in the mode tested, and
+    // leave the cache and dataset setup out of the timings
+    crypto::rx_slow_hash_free_state();
+    crypto::hash hash;
+    crypto::rx_slow_hash(0, 0, m_seed, m_data, sizeof(m_data), hash.data, miners, 0);
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hash;
+    crypto::rx_slow_hash(0, 0, m_seed, m_data, sizeof(m_data), hash.data, miners, 0);
+    return true;
+  }
+
+private:
+  char m_data[76];
+  char m_seed[32];
+};
@@ -0,0 +1,96 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/tx_selection.h"
+
+// a synthetic pool of 10000 txes, three times what fits in a block, with a
+// spread of weights and fees; prints the revenue so both selections can be
+// compared as well as timed
+template<bool knapsack>
+class test_template_selection
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t tx_count = 10000;
+  static const uint8_t version = 12;
+  static const size_t median_weight = CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V5;
+
+  test_template_selection(): m_curve(median_weight, 0, version) {}
+
+  bool init()
+  {
+    uint64_t base_reward;
+    if (!cryptonote::get_block_reward(median_weight, 0, 0, base_reward, version))
+      return false;
+    // deterministic, so runs can be compared
+    uint64_t state = 0x9e3779b97f4a7c15;
+    auto next = [&state]() { state = state * 6364136223846793005ull + 1442695040888963407ull; return state >> 33; };
+    for (size_t i = 0; i < tx_count; ++i)
+    {
+      // mostly small txes, some large ones
+      const size_t weight = next() % 8 ? 1500 + next() % 2000 : 10000 + next() % 40000;
+      // fees per byte up to about where the penalty starts to bite
+      const uint64_t fee_per_byte = base_reward / 1000000000 * (1 + next() % 1000);
+      m_candidates.push_back({weight, weight * fee_per_byte});
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(), [](const cryptonote::template_candidate &a, const cryptonote::template_candidate &b) {
+      return a.fee / (double)a.weight > b.fee / (double)b.weight;
+    });
+    m_max_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+
+    std::vector<size_t> selected;
+    const uint64_t revenue = select(selected);
+    std::cout << (knapsack ? "knapsack" : "greedy") << " selection: " << selected.size() << " txes, revenue " << cryptonote::print_money(revenue) << std::endl;
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<size_t> selected;
+    return select(selected) > 0;
+  }
+
+private:
+  uint64_t select(std::vector<size_t> &selected) const
+  {
+    if (knapsack)
+      return cryptonote::select_template_txes(m_candidates, m_curve, m_max_weight, selected);
+    return cryptonote::select_template_txes_greedy(m_candidates, m_curve, m_max_weight, selected);
+  }
+
+  cryptonote::block_reward_curve m_curve;
+  std::vector<cryptonote::template_candidate> m_candidates;
+  size_t m_max_weight;
+};
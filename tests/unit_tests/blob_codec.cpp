@@ -0,0 +1,153 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "blockchain_db/blob_codec.h"
+
+// loosely tx shaped: a repeated header, a few varints and some random bytes
+static std::string make_blob(size_t n)
+{
+  std::string blob = "\x02\x00\x01\x02\x10";
+  for (size_t i = 0; i < 16; ++i)
+    blob.push_back((char)(0x80 | (n + i) % 7));
+  std::string random(32 + n % 64, '\0');
+  crypto::generate_random_bytes_not_thread_safe(random.size(), &random[0]);
+  blob += random;
+  blob += std::string(48, '\x55');
+  return blob;
+}
+
+static std::string roundtrip(cryptonote::blob_codec &codec, const std::string &blob)
+{
+  std::string encoded, decoded;
+  codec.compress(blob.data(), blob.size(), encoded);
+  EXPECT_TRUE(codec.decompress(encoded.data(), encoded.size(), decoded));
+  return decoded;
+}
+
+TEST(blob_codec, roundtrip)
+{
+  cryptonote::blob_codec codec;
+  for (size_t n = 0; n < 100; ++n)
+  {
+    const std::string blob = make_blob(n);
+    ASSERT_EQ(roundtrip(codec, blob), blob);
+  }
+  ASSERT_EQ(roundtrip(codec, std::string()), std::string());
+}
+
+TEST(blob_codec, incompressible_kept_raw)
+{
+  cryptonote::blob_codec codec;
+  std::string blob(200, '\0'), encoded;
+  crypto::generate_random_bytes_not_thread_safe(blob.size(), &blob[0]);
+  codec.compress(blob.data(), blob.size(), encoded);
+  ASSERT_EQ(encoded.size(), blob.size() + 1);
+  ASSERT_EQ((uint8_t)encoded[0], cryptonote::blob_codec::method_raw);
+  ASSERT_EQ(roundtrip(codec, blob), blob);
+}
+
+TEST(blob_codec, compresses)
+{
+  if (!cryptonote::blob_codec::available())
+    return;
+  cryptonote::blob_codec codec;
+  const std::string blob(4096, 'x');
+  std::string encoded;
+  codec.compress(blob.data(), blob.size(), encoded);
+  ASSERT_EQ((uint8_t)encoded[0], cryptonote::blob_codec::method_zstd);
+  ASSERT_LT(encoded.size(), blob.size() / 10);
+}
+
+TEST(blob_codec, appends)
+{
+  cryptonote::blob_codec codec;
+  const std::string a = make_blob(1), b = make_blob(2);
+  std::string ea, eb, out;
+  codec.compress(a.data(), a.size(), ea);
+  codec.compress(b.data(), b.size(), eb);
+  ASSERT_TRUE(codec.decompress(ea.data(), ea.size(), out));
+  ASSERT_TRUE(codec.decompress(eb.data(), eb.size(), out));
+  ASSERT_EQ(out, a + b);
+}
+
+TEST(blob_codec, dictionary)
+{
+  if (!cryptonote::blob_codec::available())
+    return;
+  std::vector<std::string> samples;
+  for (size_t n = 0; n < 2000; ++n)
+    samples.push_back(make_blob(n));
+  std::string dictionary;
+  ASSERT_TRUE(cryptonote::blob_codec::train_dictionary(samples, 16 * 1024, dictionary));
+  ASSERT_FALSE(dictionary.empty());
+
+  cryptonote::blob_codec codec;
+  const std::string before = make_blob(5);
+  std::string encoded_before;
+  codec.compress(before.data(), before.size(), encoded_before);
+
+  codec.set_dictionary(dictionary);
+  ASSERT_TRUE(codec.has_dictionary());
+  ASSERT_EQ(codec.get_dictionary(), dictionary);
+  ASSERT_THROW(codec.set_dictionary(dictionary), std::runtime_error);
+
+  // blobs from before the dictionary still decode, new ones use it
+  std::string decoded;
+  ASSERT_TRUE(codec.decompress(encoded_before.data(), encoded_before.size(), decoded));
+  ASSERT_EQ(decoded, before);
+  for (size_t n = 0; n < 100; ++n)
+  {
+    const std::string blob = make_blob(n);
+    ASSERT_EQ(roundtrip(codec, blob), blob);
+  }
+
+  // a codec without that dictionary refuses its blobs
+  cryptonote::blob_codec other;
+  const std::string blob = make_blob(7);
+  std::string encoded;
+  codec.compress(blob.data(), blob.size(), encoded);
+  if ((uint8_t)encoded[0] == cryptonote::blob_codec::method_zstd)
+  {
+    decoded.clear();
+    ASSERT_FALSE(other.decompress(encoded.data(), encoded.size(), decoded));
+    ASSERT_TRUE(decoded.empty());
+  }
+}
+
+TEST(blob_codec, corrupt)
+{
+  cryptonote::blob_codec codec;
+  std::string out;
+  ASSERT_FALSE(codec.decompress("", 0, out));
+  ASSERT_FALSE(codec.decompress("\x07" "abc", 4, out));
+  ASSERT_FALSE(codec.decompress("\x01" "abcdefgh", 9, out));
+  ASSERT_TRUE(out.empty());
+}
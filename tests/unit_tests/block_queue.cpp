@@ -86,3 +86,18 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, get_filled_span)
+{
+  cryptonote::block_queue bq;
+  std::vector<cryptonote::block_complete_entry> bcel;
+
+  bq.add_blocks(0, 200, uuid1());
+  ASSERT_FALSE(bq.get_filled_span(0, bcel));
+  bq.add_blocks(200, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 0.0f, 0);
+  ASSERT_FALSE(bq.get_filled_span(0, bcel));
+  ASSERT_FALSE(bq.get_filled_span(199, bcel));
+  ASSERT_FALSE(bq.get_filled_span(201, bcel));
+  ASSERT_TRUE(bq.get_filled_span(200, bcel));
+  ASSERT_EQ(bcel.size(), 10);
+}
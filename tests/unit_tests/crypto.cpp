@@ -82,3 +82,55 @@ TEST(Crypto, null_keys)
   ASSERT_EQ(memcmp(crypto::null_skey.data, zero, 32), 0);
   ASSERT_EQ(memcmp(crypto::null_pkey.data, zero, 32), 0);
 }
+
+TEST(Crypto, batch_derivations)
+{
+  crypto::public_key view_pub;
+  crypto::secret_key view_sec;
+  crypto::generate_keys(view_pub, view_sec);
+
+  std::vector<crypto::public_key> keys(17);
+  for (auto &key: keys)
+  {
+    crypto::secret_key sec;
+    crypto::generate_keys(key, sec);
+  }
+  // not a point
+  memset(keys[5].data, 0xff, sizeof(keys[5].data));
+
+  std::vector<crypto::key_derivation> derivations;
+  std::vector<bool> valid;
+  ASSERT_FALSE(crypto::generate_key_derivations(keys, view_sec, derivations, valid));
+  ASSERT_EQ(derivations.size(), keys.size());
+  ASSERT_EQ(valid.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    crypto::key_derivation derivation;
+    ASSERT_EQ(valid[i], crypto::generate_key_derivation(keys[i], view_sec, derivation));
+    if (valid[i])
+      ASSERT_EQ(memcmp(&derivations[i], &derivation, sizeof(derivation)), 0);
+  }
+
+  std::vector<size_t> output_indices;
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    output_indices.push_back(i * 3);
+    if (!valid[i])
+      derivations[i] = derivations[0];
+  }
+  std::vector<crypto::public_key> derived;
+  ASSERT_FALSE(crypto::derive_subaddress_public_keys(keys, derivations, output_indices, derived, valid));
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    crypto::public_key pub;
+    ASSERT_EQ(valid[i], crypto::derive_subaddress_public_key(keys[i], derivations[i], output_indices[i], pub));
+    if (valid[i])
+      ASSERT_EQ(derived[i], pub);
+  }
+
+  keys.erase(keys.begin() + 5);
+  ASSERT_TRUE(crypto::generate_key_derivations(keys, view_sec, derivations, valid));
+  keys.clear();
+  ASSERT_TRUE(crypto::generate_key_derivations(keys, view_sec, derivations, valid));
+  ASSERT_TRUE(derivations.empty());
+}
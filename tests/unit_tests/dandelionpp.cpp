@@ -0,0 +1,454 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <vector>
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include "crypto/crypto.h"
+#include "net/levin_base.h"
+#include "storages/portable_storage_template_helper.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+#include "cryptonote_protocol/dandelionpp.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  std::vector<boost::uuids::uuid> make_peers(size_t count)
+  {
+    std::vector<boost::uuids::uuid> peers;
+    for (size_t i = 0; i < count; ++i)
+      peers.push_back(crypto::rand<boost::uuids::uuid>());
+    return peers;
+  }
+
+  bool contains(const std::vector<boost::uuids::uuid> &peers, const boost::uuids::uuid &peer)
+  {
+    return std::find(peers.begin(), peers.end(), peer) != peers.end();
+  }
+
+  // a synchronized core whose pool takes any blob, keyed by its hash;
+  // a blackhole drops the txes it is sent on their stem
+  class test_core
+  {
+  public:
+    test_core(bool dandelionpp, bool blackhole): m_dandelionpp(dandelionpp), m_blackhole(blackhole) {}
+
+    bool has_tx(const blobdata &tx) const { return m_pool.count(crypto::cn_fast_hash(tx.data(), tx.size())); }
+
+    bool handle_incoming_tx(const tx_blob_entry& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+    {
+      if (do_not_relay && m_blackhole)
+        return true;
+      if (m_pool.insert(crypto::cn_fast_hash(tx_blob.blob.data(), tx_blob.blob.size())).second)
+      {
+        tvc.m_added_to_pool = true;
+        tvc.m_should_be_relayed = !do_not_relay;
+      }
+      return true;
+    }
+    bool dandelionpp_enabled() const { return m_dandelionpp; }
+    bool pad_transactions() const { return false; }
+    void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+
+    void on_synchronized(){}
+    void safesyncmode(const bool){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool have_block(const crypto::hash& id) const {return true;}
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
+    bool handle_incoming_txs(const std::vector<tx_blob_entry>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const blobdata& block_blob, const block *b, block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, bool clip_pruned, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context){return true;}
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks) { return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    void prefetch_incoming_blocks(uint64_t height, std::vector<block_complete_entry> &&blocks_entry) {}
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_MAX_COUNT; }
+    network_type get_nettype() const { return MAINNET; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+    bool pool_has_tx(const crypto::hash &txid) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<transaction>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version() const { return 0; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    uint64_t get_earliest_ideal_height_for_version(uint8_t version) const { return 0; }
+    difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return false; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<uint64_t> &weights) { return 0; }
+    uint32_t get_blockchain_pruning_seed() const { return 0; }
+    bool has_block_weights(uint64_t height, uint64_t nblocks) const { return false; }
+    bool is_within_compiled_block_hash_area(uint64_t height) const { return false; }
+    void stop() {}
+
+  private:
+    const bool m_dandelionpp;
+    const bool m_blackhole;
+    std::unordered_set<crypto::hash> m_pool;
+  };
+
+  typedef t_cryptonote_protocol_handler<test_core> protocol_handler;
+
+  class network;
+
+  // hands what a node sends to the network instead of to sockets
+  class test_endpoint: public nodetool::p2p_endpoint_stub<cryptonote_connection_context>
+  {
+  public:
+    test_endpoint(network &net, size_t node): m_network(net), m_node(node) {}
+
+    virtual bool relay_notify_to_list(int command, const epee::span<const uint8_t> data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections);
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context);
+    virtual void for_each_connection(std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f);
+    virtual bool for_connection(const boost::uuids::uuid &connection_id, std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f);
+    virtual size_t get_zone_count() const { return 1; }
+
+  private:
+    network &m_network;
+    const size_t m_node;
+  };
+
+  // a local network of nodes running the protocol handler, connected
+  // through their endpoints, with levin messages delivered in order
+  class network
+  {
+  public:
+    struct stats
+    {
+      size_t bytes;
+      size_t stem_messages;
+      size_t fluff_messages;
+    };
+
+    network(size_t nodes, const std::vector<std::pair<size_t, size_t>> &connections, bool dandelionpp, size_t blackholes = 0):
+      m_stats({0, 0, 0})
+    {
+      std::set<size_t> blackhole_nodes;
+      while (blackhole_nodes.size() < blackholes)
+        blackhole_nodes.insert(1 + crypto::rand_idx(nodes - 1));
+      for (size_t i = 0; i < nodes; ++i)
+        m_nodes.emplace_back(new node(*this, i, dandelionpp, blackhole_nodes.count(i)));
+      for (const auto &c: connections)
+      {
+        const boost::uuids::uuid id = crypto::rand<boost::uuids::uuid>();
+        add_link(c.first, c.second, id, false);
+        add_link(c.second, c.first, id, true);
+      }
+    }
+
+    //! a tx sent to a node by a wallet
+    void add_tx(size_t origin, const blobdata &tx)
+    {
+      node &n = *m_nodes[origin];
+      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      n.core.handle_incoming_tx({tx, crypto::null_hash}, tvc, false, false, false);
+      NOTIFY_NEW_TRANSACTIONS::request arg;
+      arg.txs.push_back(tx);
+      arg.dandelionpp_fluff = false;
+      cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      static_cast<i_cryptonote_protocol&>(n.handler).relay_transactions(arg, fake_context);
+    }
+
+    //! delivers every message, ending embargoes as time goes by, for an hour
+    void run()
+    {
+      const dandelionpp::clock::time_point start = dandelionpp::clock::now();
+      for (dandelionpp::clock::duration t(0); t < std::chrono::hours(1); t += std::chrono::seconds(1))
+      {
+        deliver();
+        for (const auto &n: m_nodes)
+          n->handler.fluff_embargoed_txes(start + t);
+      }
+      deliver();
+    }
+
+    size_t count_nodes_with(const blobdata &tx) const
+    {
+      size_t count = 0;
+      for (const auto &n: m_nodes)
+        count += n->core.has_tx(tx);
+      return count;
+    }
+
+    const stats &get_stats() const { return m_stats; }
+
+    void send(size_t from, const boost::uuids::uuid &connection_id, int command, const epee::span<const uint8_t> data)
+    {
+      const auto link = m_nodes[from]->links.find(connection_id);
+      if (link == m_nodes[from]->links.end())
+        return;
+      m_stats.bytes += sizeof(epee::levin::bucket_head2) + data.size();
+      if (command == NOTIFY_NEW_TRANSACTIONS::ID)
+      {
+        NOTIFY_NEW_TRANSACTIONS::request arg;
+        epee::serialization::load_t_from_binary(arg, std::string((const char*)data.data(), data.size()));
+        ++(arg.dandelionpp_fluff ? m_stats.fluff_messages : m_stats.stem_messages);
+      }
+      m_queue.push_back({link->second.peer, connection_id, command, std::string((const char*)data.data(), data.size())});
+    }
+
+    void for_each_connection(size_t i, const std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> &f)
+    {
+      for (auto &link: m_nodes[i]->links)
+        if (!f(link.second.context, 1, P2P_SUPPORT_FLAGS))
+          break;
+    }
+
+    bool for_connection(size_t i, const boost::uuids::uuid &connection_id, const std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> &f)
+    {
+      const auto link = m_nodes[i]->links.find(connection_id);
+      if (link == m_nodes[i]->links.end())
+        return false;
+      return f(link->second.context, 1, P2P_SUPPORT_FLAGS);
+    }
+
+  private:
+    struct link
+    {
+      size_t peer;
+      cryptonote_connection_context context;
+    };
+
+    struct node
+    {
+      node(network &net, size_t i, bool dandelionpp, bool blackhole):
+        core(dandelionpp, blackhole), endpoint(net, i), handler(core, &endpoint, true) {}
+
+      test_core core;
+      test_endpoint endpoint;
+      protocol_handler handler;
+      std::map<boost::uuids::uuid, link> links;
+    };
+
+    struct message
+    {
+      size_t to;
+      boost::uuids::uuid connection_id;
+      int command;
+      std::string data;
+    };
+
+    void add_link(size_t from, size_t to, const boost::uuids::uuid &id, bool incoming)
+    {
+      link &l = m_nodes[from]->links[id];
+      l.peer = to;
+      const epee::net_utils::network_address address{epee::net_utils::ipv4_network_address{uint32_t(0x01000000 + to), 18080}};
+      static_cast<epee::net_utils::connection_context_base&>(l.context) = epee::net_utils::connection_context_base(id, address, incoming, false);
+      l.context.m_state = cryptonote_connection_context::state_normal;
+    }
+
+    void deliver()
+    {
+      while (!m_queue.empty())
+      {
+        const message msg = std::move(m_queue.front());
+        m_queue.pop_front();
+        node &n = *m_nodes[msg.to];
+        std::string out;
+        bool handled = false;
+        n.handler.handle_invoke_map(true, msg.command, epee::strspan<uint8_t>(msg.data), out, n.links[msg.connection_id].context, handled);
+      }
+    }
+
+    std::vector<std::unique_ptr<node>> m_nodes;
+    std::deque<message> m_queue;
+    stats m_stats;
+  };
+
+  bool test_endpoint::relay_notify_to_list(int command, const epee::span<const uint8_t> data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections)
+  {
+    for (const auto &c: connections)
+      m_network.send(m_node, c.second, command, data_buff);
+    return true;
+  }
+
+  bool test_endpoint::invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context)
+  {
+    m_network.send(m_node, context.m_connection_id, command, req_buff);
+    return true;
+  }
+
+  void test_endpoint::for_each_connection(std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+  {
+    m_network.for_each_connection(m_node, f);
+  }
+
+  bool test_endpoint::for_connection(const boost::uuids::uuid &connection_id, std::function<bool(cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+  {
+    return m_network.for_connection(m_node, connection_id, f);
+  }
+
+  // a ring, so it is connected, plus random outgoing connections
+  std::vector<std::pair<size_t, size_t>> make_connections(size_t nodes, size_t out_peers)
+  {
+    std::set<std::pair<size_t, size_t>> connections;
+    for (size_t i = 0; i < nodes; ++i)
+    {
+      for (size_t n = 0; n < out_peers; ++n)
+      {
+        const size_t peer = n == 0 ? (i + 1) % nodes : crypto::rand_idx(nodes);
+        if (peer != i && !connections.count({peer, i}))
+          connections.insert({i, peer});
+      }
+    }
+    return {connections.begin(), connections.end()};
+  }
+
+  std::vector<blobdata> make_txes(size_t count, size_t size)
+  {
+    std::vector<blobdata> txes;
+    for (size_t i = 0; i < count; ++i)
+    {
+      blobdata tx(size, 0);
+      crypto::generate_random_bytes_thread_safe(size, (uint8_t*)&tx[0]);
+      txes.push_back(std::move(tx));
+    }
+    return txes;
+  }
+
+  network::stats simulate(const std::vector<std::pair<size_t, size_t>> &connections, size_t nodes, bool dandelionpp, size_t blackholes, const std::vector<blobdata> &txes)
+  {
+    network net(nodes, connections, dandelionpp, blackholes);
+    for (size_t i = 0; i < txes.size(); ++i)
+      net.add_tx(i % nodes, txes[i]);
+    net.run();
+    for (const blobdata &tx: txes)
+      EXPECT_EQ(net.count_nodes_with(tx), nodes);
+    return net.get_stats();
+  }
+}
+
+TEST(dandelionpp, no_stem_without_out_peers)
+{
+  dandelionpp::router router;
+  ASSERT_TRUE(router.get_stem(boost::uuids::nil_uuid(), {}, dandelionpp::clock::now()).is_nil());
+}
+
+TEST(dandelionpp, stems_are_kept_for_the_epoch)
+{
+  dandelionpp::router router(2, 0);
+  const std::vector<boost::uuids::uuid> out_peers = make_peers(8);
+  const dandelionpp::clock::time_point now = dandelionpp::clock::now();
+
+  std::set<boost::uuids::uuid> stems;
+  const boost::uuids::uuid local = router.get_stem(boost::uuids::nil_uuid(), out_peers, now);
+  ASSERT_TRUE(contains(out_peers, local));
+  for (const boost::uuids::uuid &source: make_peers(32))
+  {
+    const boost::uuids::uuid stem = router.get_stem(source, out_peers, now);
+    ASSERT_TRUE(contains(out_peers, stem));
+    ASSERT_EQ(router.get_stem(source, out_peers, now + std::chrono::seconds(60)), stem);
+    stems.insert(stem);
+  }
+  ASSERT_LE(stems.size(), 2);
+  ASSERT_EQ(router.get_stem(boost::uuids::nil_uuid(), out_peers, now + std::chrono::seconds(60)), local);
+}
+
+TEST(dandelionpp, lost_stem_is_replaced)
+{
+  dandelionpp::router router(2, 0);
+  std::vector<boost::uuids::uuid> out_peers = make_peers(8);
+  const dandelionpp::clock::time_point now = dandelionpp::clock::now();
+
+  const boost::uuids::uuid stem = router.get_stem(boost::uuids::nil_uuid(), out_peers, now);
+  out_peers.erase(std::find(out_peers.begin(), out_peers.end(), stem));
+  const boost::uuids::uuid replacement = router.get_stem(boost::uuids::nil_uuid(), out_peers, now);
+  ASSERT_TRUE(contains(out_peers, replacement));
+}
+
+TEST(dandelionpp, fluff_epoch_only_stems_own_txes)
+{
+  dandelionpp::router router(2, 100);
+  const std::vector<boost::uuids::uuid> out_peers = make_peers(8);
+  const dandelionpp::clock::time_point now = dandelionpp::clock::now();
+
+  ASSERT_TRUE(router.get_stem(out_peers[0], out_peers, now).is_nil());
+  ASSERT_TRUE(contains(out_peers, router.get_stem(boost::uuids::nil_uuid(), out_peers, now)));
+}
+
+TEST(dandelionpp, never_stems_back_to_source)
+{
+  dandelionpp::router router(1, 0);
+  const std::vector<boost::uuids::uuid> out_peers = make_peers(1);
+  ASSERT_TRUE(router.get_stem(out_peers[0], out_peers, dandelionpp::clock::now()).is_nil());
+}
+
+TEST(dandelionpp, embargo)
+{
+  dandelionpp::router router;
+  const dandelionpp::clock::time_point now = dandelionpp::clock::now();
+  const crypto::hash h0 = crypto::rand<crypto::hash>(), h1 = crypto::rand<crypto::hash>();
+
+  ASSERT_TRUE(router.add_embargo(h0, "tx0", now));
+  ASSERT_FALSE(router.add_embargo(h0, "tx0", now));
+  ASSERT_TRUE(router.add_embargo(h1, "tx1", now));
+  ASSERT_EQ(router.get_embargo_count(), 2);
+
+  ASSERT_TRUE(router.remove_embargo(h1));
+  ASSERT_FALSE(router.remove_embargo(h1));
+
+  const std::vector<blobdata> expired = router.take_expired_embargoes(now + std::chrono::hours(1));
+  ASSERT_EQ(expired, std::vector<blobdata>{"tx0"});
+  ASSERT_EQ(router.get_embargo_count(), 0);
+}
+
+TEST(dandelionpp, network_bytes_per_tx)
+{
+  static const size_t nodes = 50;
+  const std::vector<std::pair<size_t, size_t>> connections = make_connections(nodes, 8);
+  const std::vector<blobdata> txes = make_txes(20, 2000);
+
+  const network::stats flood = simulate(connections, nodes, false, 0, txes);
+  const network::stats stem = simulate(connections, nodes, true, 0, txes);
+  const network::stats lossy = simulate(connections, nodes, true, 5, txes);
+
+  MINFO("bytes sent per tx: flood " << flood.bytes / txes.size()
+    << ", Dandelion++ " << stem.bytes / txes.size()
+    << ", Dandelion++ with 5 stem blackholes " << lossy.bytes / txes.size());
+
+  // each node fluffs a tx at most once, to all but where it came from,
+  // so Dandelion++ only adds the stem hops and embargo fluffs
+  ASSERT_EQ(flood.stem_messages, 0);
+  ASSERT_GT(stem.stem_messages, 0);
+  ASSERT_LE(stem.fluff_messages, flood.fluff_messages + nodes * txes.size());
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "blockchain_db/key_image_filter.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+
+static std::vector<crypto::key_image> random_key_images(size_t n)
+{
+  std::vector<crypto::key_image> key_images(n);
+  crypto::generate_random_bytes_not_thread_safe(n * sizeof(crypto::key_image), key_images.data());
+  return key_images;
+}
+
+TEST(key_image_filter, empty)
+{
+  cryptonote::key_image_filter filter;
+  ASSERT_EQ(filter.size(), 0);
+  for (const auto &ki: random_key_images(100))
+    ASSERT_FALSE(filter.may_contain(ki));
+}
+
+TEST(key_image_filter, no_false_negatives)
+{
+  const auto key_images = random_key_images(50000);
+  cryptonote::key_image_filter filter(key_images.size());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.insert(ki));
+  ASSERT_EQ(filter.size(), key_images.size());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.may_contain(ki));
+}
+
+TEST(key_image_filter, false_positives)
+{
+  cryptonote::key_image_filter filter(50000);
+  for (const auto &ki: random_key_images(50000))
+    ASSERT_TRUE(filter.insert(ki));
+  size_t false_positives = 0;
+  for (const auto &ki: random_key_images(100000))
+    false_positives += filter.may_contain(ki);
+  ASSERT_LT(false_positives, 100);
+}
+
+TEST(key_image_filter, remove)
+{
+  const auto key_images = random_key_images(1000);
+  cryptonote::key_image_filter filter;
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.insert(ki));
+  for (size_t n = 0; n < key_images.size(); n += 2)
+    ASSERT_TRUE(filter.remove(key_images[n]));
+  ASSERT_EQ(filter.size(), key_images.size() / 2);
+  for (size_t n = 1; n < key_images.size(); n += 2)
+    ASSERT_TRUE(filter.may_contain(key_images[n]));
+}
+
+TEST(key_image_filter, duplicates)
+{
+  const auto key_images = random_key_images(1);
+  cryptonote::key_image_filter filter;
+  ASSERT_TRUE(filter.insert(key_images[0]));
+  ASSERT_TRUE(filter.insert(key_images[0]));
+  ASSERT_TRUE(filter.remove(key_images[0]));
+  ASSERT_TRUE(filter.may_contain(key_images[0]));
+  ASSERT_TRUE(filter.remove(key_images[0]));
+  ASSERT_FALSE(filter.may_contain(key_images[0]));
+}
+
+TEST(key_image_filter, full)
+{
+  cryptonote::key_image_filter filter;
+  const auto key_images = random_key_images(filter.capacity() + 1);
+  size_t inserted = 0;
+  while (inserted < key_images.size() && filter.insert(key_images[inserted]))
+    ++inserted;
+  ASSERT_LT(inserted, key_images.size());
+  ASSERT_GT(inserted, filter.capacity() * 9 / 10);
+  // nothing inserted was lost on the way
+  for (size_t n = 0; n < inserted; ++n)
+    ASSERT_TRUE(filter.may_contain(key_images[n]));
+  // and removing makes room again
+  for (size_t n = 0; n < inserted; ++n)
+    ASSERT_TRUE(filter.remove(key_images[n]));
+  ASSERT_EQ(filter.size(), 0);
+  ASSERT_TRUE(filter.insert(key_images[inserted]));
+}
+
+TEST(key_image_filter, serialize)
+{
+  const auto key_images = random_key_images(1000);
+  cryptonote::key_image_filter filter;
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.insert(ki));
+  const std::string data = filter.serialize();
+
+  cryptonote::key_image_filter loaded;
+  ASSERT_TRUE(loaded.deserialize(data));
+  ASSERT_EQ(loaded.size(), filter.size());
+  ASSERT_EQ(loaded.capacity(), filter.capacity());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(loaded.may_contain(ki));
+
+  ASSERT_FALSE(loaded.deserialize(data.substr(0, data.size() - 1)));
+  ASSERT_FALSE(loaded.deserialize("kifilt02" + data.substr(8)));
+}
+
+namespace
+{
+  // adds a block spending the given key images, with a v2 miner tx and no outputs
+  void add_block_spending(cryptonote::BlockchainDB &db, const std::vector<crypto::key_image> &key_images)
+  {
+    cryptonote::block b;
+    b.major_version = db.height() ? 7 : 1;
+    b.minor_version = b.major_version;
+    b.timestamp = db.height();
+    b.prev_id = db.height() ? db.top_block_hash() : crypto::null_hash;
+    b.miner_tx.version = 2;
+    b.miner_tx.vin.push_back(cryptonote::txin_gen{db.height()});
+    b.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+
+    std::vector<std::pair<cryptonote::transaction, cryptonote::blobdata>> txs;
+    if (!key_images.empty())
+    {
+      cryptonote::transaction tx;
+      tx.version = 2;
+      for (const auto &ki: key_images)
+        tx.vin.push_back(cryptonote::txin_to_key{0, {0}, ki});
+      tx.rct_signatures.type = rct::RCTTypeNull;
+      b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+      txs.push_back(std::make_pair(tx, cryptonote::tx_to_blob(tx)));
+    }
+
+    cryptonote::db_wtxn_guard guard(&db);
+    db.add_block(std::make_pair(b, cryptonote::block_to_blob(b)), 1, 1, db.height() + 1, 0, txs);
+  }
+}
+
+TEST(key_image_filter, rebuilt_while_the_db_changes)
+{
+  const boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  cryptonote::BlockchainLMDB db;
+  cryptonote::HardFork hardfork(db, 1, 0);
+  db.open(path.string(), DBF_FAST);
+  hardfork.init();
+  db.set_hard_fork(&hardfork);
+  add_block_spending(db, {});
+
+  // more than a new filter holds: it is rebuilt once this is committed, while
+  // more key images are added and removed, whichever finishes first
+  const auto key_images = random_key_images(50000);
+  const auto more = random_key_images(10);
+  const auto popped = random_key_images(10);
+  add_block_spending(db, key_images);
+  add_block_spending(db, popped);
+  cryptonote::block b;
+  std::vector<cryptonote::transaction> txs;
+  db.pop_block(b, txs);
+  add_block_spending(db, more);
+
+  for (const auto *set: {&key_images, &more})
+    for (const auto &ki: *set)
+      ASSERT_TRUE(db.has_key_image(ki));
+  for (const auto &ki: popped)
+    ASSERT_FALSE(db.has_key_image(ki));
+
+  // the filter saved on close, once the rebuild is done, is used on open
+  db.close();
+  db.open(path.string(), DBF_FAST);
+  for (const auto *set: {&key_images, &more})
+    for (const auto &ki: *set)
+      ASSERT_TRUE(db.has_key_image(ki));
+  for (const auto &ki: popped)
+    ASSERT_FALSE(db.has_key_image(ki));
+  db.close();
+  boost::filesystem::remove_all(path);
+}
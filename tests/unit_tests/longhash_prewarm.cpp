@@ -0,0 +1,122 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include "common/threadpool.h"
+#include "cryptonote_core/longhash_prewarm.h"
+
+TEST(longhash_prewarm, prewarms_seeds_in_order)
+{
+  std::vector<uint64_t> heights;
+  cryptonote::longhash_prewarmer prewarmer([&heights](uint64_t seed_height, const crypto::hash&) { heights.push_back(seed_height); });
+  ASSERT_TRUE(prewarmer.start({{2048, crypto::null_hash}, {4096, crypto::null_hash}}));
+  prewarmer.join();
+  ASSERT_EQ(std::vector<uint64_t>({2048, 4096}), heights);
+}
+
+TEST(longhash_prewarm, caches_before_datasets)
+{
+  std::vector<std::pair<char, uint64_t>> steps;
+  std::vector<std::thread::id> threads;
+  cryptonote::longhash_prewarmer prewarmer(
+    [&](uint64_t seed_height, const crypto::hash&) { steps.push_back({'c', seed_height}); threads.push_back(std::this_thread::get_id()); },
+    [&](uint64_t seed_height, const crypto::hash&) { steps.push_back({'d', seed_height}); threads.push_back(std::this_thread::get_id()); });
+  ASSERT_TRUE(prewarmer.start({{2048, crypto::null_hash}, {4096, crypto::null_hash}}));
+  prewarmer.join();
+  const std::vector<std::pair<char, uint64_t>> expected{{'c', 2048}, {'c', 4096}, {'d', 2048}, {'d', 4096}};
+  ASSERT_EQ(expected, steps);
+  for (const std::thread::id &id: threads)
+  {
+    ASSERT_EQ(threads[0], id);
+    ASSERT_NE(std::this_thread::get_id(), id);
+  }
+}
+
+TEST(longhash_prewarm, busy)
+{
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<unsigned> runs(0);
+  cryptonote::longhash_prewarmer prewarmer([&](uint64_t, const crypto::hash&) { ++runs; released.wait(); });
+  ASSERT_TRUE(prewarmer.start({{2048, crypto::null_hash}}));
+  ASSERT_FALSE(prewarmer.start({{4096, crypto::null_hash}}));
+  release.set_value();
+  prewarmer.join();
+  ASSERT_TRUE(prewarmer.start({{4096, crypto::null_hash}}));
+  prewarmer.join();
+  ASSERT_EQ(2, runs.load());
+}
+
+TEST(longhash_prewarm, not_run_by_verification)
+{
+  tools::threadpool &tpool = tools::threadpool::getInstance();
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+
+  // keep all the pool threads busy, so anything queued stays queued
+  const unsigned pool_threads = tpool.get_max_concurrency() - 1;
+  std::atomic<unsigned> busy(0);
+  tools::threadpool::waiter blockers;
+  for (unsigned n = 0; n < pool_threads; ++n)
+    tpool.submit(&blockers, [&]() { ++busy; released.wait(); });
+  while (busy < pool_threads)
+    std::this_thread::yield();
+
+  std::promise<std::thread::id> prewarmed_on;
+  cryptonote::longhash_prewarmer prewarmer([&](uint64_t, const crypto::hash&) {
+    prewarmed_on.set_value(std::this_thread::get_id());
+    released.wait();
+  });
+  ASSERT_TRUE(prewarmer.start({{2048, crypto::null_hash}}));
+
+  // verification waits on the pool, and so runs whatever is queued there
+  std::promise<std::thread::id> verified_on;
+  std::thread verifier([&]() {
+    tools::threadpool::waiter waiter;
+    tpool.submit(&waiter, []() {});
+    waiter.wait(&tpool);
+    verified_on.set_value(std::this_thread::get_id());
+  });
+  std::future<std::thread::id> verified = verified_on.get_future();
+  const bool verification_done = verified.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+
+  std::future<std::thread::id> prewarmed = prewarmed_on.get_future();
+  const std::thread::id prewarm_thread = prewarmed.get();
+  release.set_value();
+  verifier.join();
+  blockers.wait(NULL);
+  prewarmer.join();
+
+  ASSERT_TRUE(verification_done);
+  ASSERT_NE(verified.get(), prewarm_thread);
+}
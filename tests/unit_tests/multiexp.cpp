@@ -0,0 +1,83 @@
+// Copyright (c) 2021-2024, The GNTL Project
+// Copyright (c) 2018-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "ringct/rctOps.h"
+#include "ringct/multiexp.h"
+
+static std::vector<rct::MultiexpData> make_data(size_t N)
+{
+  std::vector<rct::MultiexpData> data;
+  data.reserve(N);
+  for (size_t n = 0; n < N; ++n)
+    data.push_back({rct::skGen(), rct::scalarmultBase(rct::skGen())});
+  return data;
+}
+
+static rct::key naive_multiexp(const std::vector<rct::MultiexpData> &data)
+{
+  rct::key res = rct::identity();
+  for (const auto &d: data)
+  {
+    rct::key P;
+    ge_p3_tobytes(P.bytes, &d.point);
+    rct::addKeys(res, res, rct::scalarmultKey(P, d.scalar));
+  }
+  return res;
+}
+
+TEST(multiexp, pippenger_threaded_matches_serial)
+{
+  for (size_t N: {1, 2, 17, 600, 1500})
+  {
+    const std::vector<rct::MultiexpData> data = make_data(N);
+    const rct::key serial = rct::pippenger(data, NULL, 0, 0, 1);
+    ASSERT_EQ(serial, naive_multiexp(data));
+    for (size_t threads: {2, 3, 8, 64})
+      ASSERT_EQ(serial, rct::pippenger(data, NULL, 0, 0, threads));
+    ASSERT_EQ(serial, rct::pippenger(data));
+  }
+}
+
+TEST(multiexp, pippenger_threaded_cached)
+{
+  const std::vector<rct::MultiexpData> data = make_data(1024);
+  const std::shared_ptr<rct::pippenger_cached_data> cache = rct::pippenger_init_cache(data, 0, 512);
+  const rct::key serial = rct::pippenger(data, cache, 512, 0, 1);
+  ASSERT_EQ(serial, rct::straus(data));
+  ASSERT_EQ(serial, rct::pippenger(data, cache, 512, 0, 4));
+}
+
+TEST(multiexp, pippenger_threads)
+{
+  ASSERT_EQ(rct::get_pippenger_threads(1), 1);
+  ASSERT_GE(rct::get_pippenger_threads(65536), 1);
+}
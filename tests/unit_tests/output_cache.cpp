@@ -0,0 +1,223 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "gtest/gtest.h"
+
+#include "blockchain_db/output_cache.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+
+static cryptonote::output_data_t make_output(uint64_t n)
+{
+  cryptonote::output_data_t data;
+  memset(&data, 0, sizeof(data));
+  memcpy(&data.pubkey, &n, sizeof(n));
+  data.unlock_time = n;
+  data.height = n;
+  return data;
+}
+
+TEST(output_cache, get_put)
+{
+  cryptonote::output_cache cache(1024 * 1024);
+  cryptonote::output_data_t data;
+  ASSERT_FALSE(cache.get(7, data));
+  cache.put(7, make_output(7), cache.epoch());
+  ASSERT_TRUE(cache.get(7, data));
+  const cryptonote::output_data_t expected = make_output(7);
+  ASSERT_EQ(memcmp(&data, &expected, sizeof(data)), 0);
+  ASSERT_EQ(cache.hits(), 1);
+  ASSERT_EQ(cache.misses(), 1);
+}
+
+TEST(output_cache, eviction)
+{
+  cryptonote::output_cache cache(64 * 1024);
+  const size_t capacity = cache.capacity();
+  ASSERT_GT(capacity, 0);
+  for (uint64_t n = 0; n < capacity * 2; ++n)
+    cache.put(n, make_output(n), cache.epoch());
+  ASSERT_LE(cache.size(), capacity);
+
+  // the most recent ones are kept, the oldest ones are gone
+  cryptonote::output_data_t data;
+  ASSERT_TRUE(cache.get(capacity * 2 - 1, data));
+  ASSERT_FALSE(cache.get(0, data));
+}
+
+TEST(output_cache, lru)
+{
+  cryptonote::output_cache cache(64 * 1024);
+  const size_t capacity = cache.capacity();
+  cache.put(0, make_output(0), cache.epoch());
+  cryptonote::output_data_t data;
+  for (uint64_t n = 1; n < capacity * 2; ++n)
+  {
+    // keep touching output 0
+    ASSERT_TRUE(cache.get(0, data));
+    cache.put(n, make_output(n), cache.epoch());
+  }
+  ASSERT_TRUE(cache.get(0, data));
+}
+
+TEST(output_cache, invalidate)
+{
+  cryptonote::output_cache cache(1024 * 1024);
+  const uint64_t epoch = cache.epoch();
+  cache.put(1, make_output(1), epoch);
+  cache.invalidate();
+  cryptonote::output_data_t data;
+  ASSERT_FALSE(cache.get(1, data));
+  ASSERT_EQ(cache.size(), 0);
+
+  // a value read before the invalidation is refused
+  cache.put(2, make_output(2), epoch);
+  ASSERT_FALSE(cache.get(2, data));
+  cache.put(2, make_output(2), cache.epoch());
+  ASSERT_TRUE(cache.get(2, data));
+}
+
+TEST(output_cache, disabled)
+{
+  cryptonote::output_cache cache(0);
+  cache.put(1, make_output(1), cache.epoch());
+  cryptonote::output_data_t data;
+  ASSERT_FALSE(cache.get(1, data));
+}
+
+namespace
+{
+  class output_cache_db: public ::testing::Test
+  {
+  protected:
+    output_cache_db(): m_path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()), m_hardfork(m_db, 1, 0)
+    {
+      m_db.open(m_path.string());
+      m_hardfork.init();
+      m_db.set_hard_fork(&m_hardfork);
+    }
+
+    ~output_cache_db()
+    {
+      m_db.close();
+      boost::filesystem::remove_all(m_path);
+    }
+
+    // adds a block whose miner tx has one rct output, and returns its key
+    crypto::public_key add_block()
+    {
+      cryptonote::block b;
+      b.major_version = m_db.height() ? 7 : 1;
+      b.minor_version = b.major_version;
+      b.timestamp = m_db.height();
+      b.prev_id = m_db.height() ? m_db.top_block_hash() : crypto::null_hash;
+      b.miner_tx.version = 2;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{m_db.height()});
+      cryptonote::tx_out out;
+      out.amount = 0;
+      out.target = cryptonote::txout_to_key(crypto::rand<crypto::public_key>());
+      b.miner_tx.vout.push_back(out);
+      b.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+      cryptonote::db_wtxn_guard guard(&m_db);
+      m_db.add_block(std::make_pair(b, cryptonote::block_to_blob(b)), 1, 1, m_db.height() + 1, 0, {});
+      return boost::get<cryptonote::txout_to_key>(out.target).key;
+    }
+
+    void pop_block()
+    {
+      cryptonote::block b;
+      std::vector<cryptonote::transaction> txs;
+      m_db.pop_block(b, txs);
+    }
+
+    // reads an output on a thread of its own, so with a new snapshot
+    crypto::public_key read_output(uint64_t index)
+    {
+      crypto::public_key key;
+      boost::thread reader([&](){
+        cryptonote::db_rtxn_guard guard(&m_db);
+        key = m_db.get_output_key(0, index, true).pubkey;
+      });
+      reader.join();
+      return key;
+    }
+
+    boost::filesystem::path m_path;
+    cryptonote::BlockchainLMDB m_db;
+    cryptonote::HardFork m_hardfork;
+  };
+}
+
+TEST_F(output_cache_db, read_while_reorging)
+{
+  add_block();
+  const crypto::public_key old_key = add_block();
+  ASSERT_EQ(read_output(1), old_key);
+
+  // a reader starting while the output is being replaced still sees it,
+  // but must not leave it in the cache for readers after the commit
+  ASSERT_TRUE(m_db.batch_start());
+  pop_block();
+  const crypto::public_key new_key = add_block();
+  ASSERT_EQ(read_output(1), old_key);
+  ASSERT_EQ(read_output(1), old_key);
+  m_db.batch_stop();
+
+  ASSERT_EQ(read_output(1), new_key);
+  ASSERT_EQ(read_output(1), new_key);
+}
+
+TEST_F(output_cache_db, old_snapshot)
+{
+  add_block();
+  const crypto::public_key old_key = add_block();
+
+  // a reader keeps its snapshot across a reorg, while newer readers cache
+  // the replacement output: each one must see its own chain
+  boost::barrier snapshot_taken(2), reorged(2);
+  crypto::public_key before;
+  boost::thread reader([&](){
+    cryptonote::db_rtxn_guard guard(&m_db);
+    snapshot_taken.wait();
+    reorged.wait();
+    before = m_db.get_output_key(0, 1, true).pubkey;
+  });
+  snapshot_taken.wait();
+  pop_block();
+  const crypto::public_key new_key = add_block();
+  ASSERT_EQ(read_output(1), new_key);
+  ASSERT_EQ(read_output(1), new_key);
+  reorged.wait();
+  reader.join();
+  ASSERT_EQ(before, old_key);
+}
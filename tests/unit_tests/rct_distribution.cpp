@@ -0,0 +1,198 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "gtest/gtest.h"
+
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  class rct_distribution: public ::testing::Test
+  {
+  protected:
+    rct_distribution(): m_path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()), m_hardfork(m_db, 1, 0)
+    {
+      m_db.open(m_path.string());
+      m_hardfork.init();
+      m_db.set_hard_fork(&m_hardfork);
+    }
+
+    ~rct_distribution()
+    {
+      m_db.close();
+      boost::filesystem::remove_all(m_path);
+    }
+
+    // a block whose v2 miner tx has the given number of rct outputs
+    block make_block(size_t outs) const
+    {
+      block b;
+      // the genesis block has no parent to carry the count from
+      b.major_version = m_db.height() ? 7 : 1;
+      b.minor_version = b.major_version;
+      b.timestamp = m_db.height();
+      b.prev_id = m_db.height() ? m_db.top_block_hash() : crypto::null_hash;
+      b.miner_tx.version = 2;
+      b.miner_tx.vin.push_back(txin_gen{m_db.height()});
+      for (size_t n = 0; n < outs; ++n)
+      {
+        tx_out out;
+        out.amount = 0;
+        out.target = txout_to_key(crypto::rand<crypto::public_key>());
+        b.miner_tx.vout.push_back(out);
+      }
+      b.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+      return b;
+    }
+
+    void add_block(size_t outs)
+    {
+      const block b = make_block(outs);
+      db_wtxn_guard guard(&m_db);
+      m_db.add_block(std::make_pair(b, block_to_blob(b)), 1, 1, m_db.height() + 1, 0, {});
+    }
+
+    void pop_block()
+    {
+      block b;
+      std::vector<transaction> txs;
+      m_db.pop_block(b, txs);
+    }
+
+    std::vector<uint64_t> distribution(uint64_t to_height)
+    {
+      std::vector<uint64_t> d;
+      EXPECT_TRUE(m_db.get_rct_output_distribution(0, to_height, d));
+      return d;
+    }
+
+    boost::filesystem::path m_path;
+    BlockchainLMDB m_db;
+    HardFork m_hardfork;
+  };
+}
+
+TEST_F(rct_distribution, cumulative)
+{
+  add_block(1);
+  add_block(2);
+  add_block(3);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 6}));
+  std::vector<uint64_t> d;
+  ASSERT_TRUE(m_db.get_rct_output_distribution(1, 2, d));
+  ASSERT_EQ(d, std::vector<uint64_t>({3, 6}));
+  ASSERT_FALSE(m_db.get_rct_output_distribution(0, 3, d));
+}
+
+TEST_F(rct_distribution, pop_block)
+{
+  add_block(1);
+  add_block(2);
+  add_block(3);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 6}));
+
+  pop_block();
+  std::vector<uint64_t> d;
+  ASSERT_FALSE(m_db.get_rct_output_distribution(0, 2, d));
+  ASSERT_EQ(distribution(1), std::vector<uint64_t>({1, 3}));
+
+  add_block(5);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 8}));
+}
+
+TEST_F(rct_distribution, reorg)
+{
+  add_block(1);
+  add_block(2);
+  add_block(3);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 6}));
+
+  pop_block();
+  pop_block();
+  add_block(4);
+  add_block(5);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 5, 10}));
+}
+
+TEST_F(rct_distribution, popped_within_writer)
+{
+  add_block(1);
+  add_block(2);
+  ASSERT_EQ(distribution(1), std::vector<uint64_t>({1, 3}));
+
+  // the writer sees its own replacement block before it is committed, and
+  // nobody sees it cached after the batch is abandoned
+  ASSERT_TRUE(m_db.batch_start());
+  pop_block();
+  add_block(7);
+  ASSERT_EQ(distribution(1), std::vector<uint64_t>({1, 8}));
+  m_db.batch_abort();
+  ASSERT_EQ(distribution(1), std::vector<uint64_t>({1, 3}));
+}
+
+TEST_F(rct_distribution, old_snapshot)
+{
+  add_block(1);
+  add_block(2);
+  add_block(3);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 6}));
+
+  // a reader keeps its snapshot across a reorg, while newer readers fill the
+  // table from the new chain: each one must see its own chain
+  boost::barrier snapshot_taken(2), reorged(2);
+  std::vector<uint64_t> before, after;
+  boost::thread reader([&](){
+    db_rtxn_guard guard(&m_db);
+    snapshot_taken.wait();
+    reorged.wait();
+    EXPECT_TRUE(m_db.get_rct_output_distribution(0, 2, before));
+  });
+  snapshot_taken.wait();
+  pop_block();
+  add_block(5);
+  ASSERT_EQ(distribution(2), std::vector<uint64_t>({1, 3, 8}));
+  reorged.wait();
+  reader.join();
+  ASSERT_EQ(before, std::vector<uint64_t>({1, 3, 6}));
+
+  boost::thread new_reader([&](){
+    db_rtxn_guard guard(&m_db);
+    EXPECT_TRUE(m_db.get_rct_output_distribution(0, 2, after));
+  });
+  new_reader.join();
+  ASSERT_EQ(after, std::vector<uint64_t>({1, 3, 8}));
+}
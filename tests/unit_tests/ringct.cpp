@@ -1053,6 +1053,47 @@ TEST(ringct, reject_gen_non_simple_ver_simple)
   ASSERT_FALSE(rct::verRctSimple(sig));
 }
 
+TEST(ringct, ver_non_semantics_simple_batch)
+{
+  const uint64_t inputs1[] = {1000};
+  const uint64_t inputs4[] = {1000, 1000, 1000, 1000};
+  const uint64_t outputs[] = {500};
+  std::vector<rct::rctSig> sigs;
+  sigs.push_back(make_sample_simple_rct_sig(NELTS(inputs4), inputs4, NELTS(outputs), outputs, 3500));
+  for (int n = 0; n < 4; ++n)
+    sigs.push_back(make_sample_simple_rct_sig(NELTS(inputs1), inputs1, NELTS(outputs), outputs, 500));
+
+  std::vector<const rct::rctSig*> rvv;
+  for (const rct::rctSig &sig: sigs)
+    rvv.push_back(&sig);
+  ASSERT_TRUE(rct::verRctNonSemanticsSimple(rvv));
+
+  // a bad input in any of them fails the batch
+  sigs[3].p.MGs[0].ss[0][0] = rct::skGen();
+  ASSERT_FALSE(rct::verRctNonSemanticsSimple(rvv));
+  ASSERT_TRUE(rct::verRctNonSemanticsSimple(std::vector<const rct::rctSig*>(rvv.begin(), rvv.begin() + 3)));
+}
+
+TEST(ringct, ver_semantics_simple_each)
+{
+  const uint64_t inputs[] = {1000};
+  const uint64_t outputs[] = {500};
+  std::vector<rct::rctSig> sigs;
+  for (int n = 0; n < 5; ++n)
+    sigs.push_back(make_sample_simple_rct_sig(NELTS(inputs), inputs, NELTS(outputs), outputs, 500));
+
+  std::vector<const rct::rctSig*> rvv;
+  for (const rct::rctSig &sig: sigs)
+    rvv.push_back(&sig);
+  ASSERT_EQ(rct::verRctSemanticsSimpleEach(rvv), std::vector<bool>(5, true));
+
+  // a bad range proof fails the batch, but only its own tx
+  sigs[3].p.rangeSigs[0].asig.ee = rct::skGen();
+  ASSERT_FALSE(rct::verRctSemanticsSimple(rvv));
+  const std::vector<bool> valid = rct::verRctSemanticsSimpleEach(rvv);
+  ASSERT_EQ(valid, std::vector<bool>({true, true, true, false, true}));
+}
+
 TEST(ringct, key_ostream)
 {
   std::stringstream out;
@@ -794,6 +794,129 @@ TEST(Serialization, portability_wallet)
   }
 }
 
+TEST(Serialization, portability_wallet_history)
+{
+  const cryptonote::network_type nettype = cryptonote::TESTNET;
+  const boost::filesystem::path wallet_file = unit_test::data_dir / "wallet_9svHk1";
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  const boost::filesystem::path v27_file = dir / "wallet_v27";
+  const boost::filesystem::path v27_file2 = dir / "wallet_v27_2";
+  string password = "test";
+  boost::filesystem::create_directory(dir);
+
+  // a wallet from before version 27 reads its history in place
+  std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
+  std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> confirmed;
+  {
+    tools::wallet2 w(nettype);
+    ASSERT_NO_THROW(w.load(wallet_file.string(), password));
+    ASSERT_TRUE(w.m_history_loaded);
+    ASSERT_EQ(w.m_payments.size(), 2);
+    ASSERT_EQ(w.m_confirmed_txs.size(), 1);
+    w.get_payments(payments, 0);
+    w.get_payments_out(confirmed, 0);
+    ASSERT_EQ(payments.size(), 2);
+    ASSERT_NO_THROW(w.store_to(v27_file.string(), password));
+  }
+
+  // stored again, it is kept as a blob until first needed
+  std::string blob;
+  {
+    tools::wallet2 w(nettype);
+    ASSERT_NO_THROW(w.load(v27_file.string(), password));
+    ASSERT_FALSE(w.m_history_loaded);
+    ASSERT_TRUE(w.m_payments.empty());
+    ASSERT_TRUE(w.m_confirmed_txs.empty());
+    ASSERT_FALSE(w.m_history_blob.empty());
+    ASSERT_EQ(w.m_transfers.size(), 3);
+    blob = w.m_history_blob;
+
+    // and written back verbatim if it never was
+    ASSERT_NO_THROW(w.store_to(v27_file2.string(), password));
+    ASSERT_FALSE(w.m_history_loaded);
+  }
+
+  {
+    tools::wallet2 w(nettype);
+    ASSERT_NO_THROW(w.load(v27_file2.string(), password));
+    ASSERT_FALSE(w.m_history_loaded);
+    ASSERT_EQ(w.m_history_blob, blob);
+
+    std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments2;
+    std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> confirmed2;
+    w.get_payments(payments2, 0);
+    ASSERT_TRUE(w.m_history_loaded);
+    ASSERT_TRUE(w.m_history_blob.empty());
+    w.get_payments_out(confirmed2, 0);
+    ASSERT_EQ(w.m_payments.size(), 2);
+    ASSERT_EQ(w.m_confirmed_txs.size(), 1);
+
+    auto by_tx = [](const std::pair<crypto::hash, tools::wallet2::payment_details> &a, const std::pair<crypto::hash, tools::wallet2::payment_details> &b)
+      { return memcmp(&a.second.m_tx_hash, &b.second.m_tx_hash, sizeof(crypto::hash)) < 0; };
+    payments.sort(by_tx);
+    payments2.sort(by_tx);
+    ASSERT_EQ(payments2.size(), payments.size());
+    for (auto i = payments.begin(), j = payments2.begin(); i != payments.end(); ++i, ++j)
+    {
+      ASSERT_EQ(i->first, j->first);
+      ASSERT_EQ(i->second.m_tx_hash, j->second.m_tx_hash);
+      ASSERT_EQ(i->second.m_amount, j->second.m_amount);
+      ASSERT_EQ(i->second.m_block_height, j->second.m_block_height);
+      ASSERT_EQ(i->second.m_unlock_time, j->second.m_unlock_time);
+      ASSERT_EQ(i->second.m_timestamp, j->second.m_timestamp);
+    }
+    ASSERT_EQ(confirmed2.size(), confirmed.size());
+    ASSERT_EQ(confirmed2.front().first, confirmed.front().first);
+    ASSERT_EQ(confirmed2.front().second.m_amount_in, confirmed.front().second.m_amount_in);
+    ASSERT_EQ(confirmed2.front().second.m_amount_out, confirmed.front().second.m_amount_out);
+    ASSERT_EQ(confirmed2.front().second.m_block_height, confirmed.front().second.m_block_height);
+  }
+
+  boost::filesystem::remove_all(dir);
+}
+
+TEST(Serialization, wallet_cache_log_password_change)
+{
+  const cryptonote::network_type nettype = cryptonote::TESTNET;
+  const boost::filesystem::path wallet_file = unit_test::data_dir / "wallet_9svHk1";
+  const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  const boost::filesystem::path file = dir / "wallet";
+  const std::string delta_file = file.string() + ".delta";
+  boost::filesystem::create_directory(dir);
+
+  crypto::hash txid[2];
+  epee::string_tools::hex_to_pod("15024343b38e77a1a9860dfed29921fa17e833fec837191a6b04fa7cb9605b8e", txid[0]);
+  epee::string_tools::hex_to_pod("6e7013684d35820f66c6679197ded9329bfe0e495effa47e7b25258799858dba", txid[1]);
+  {
+    tools::wallet2 w(nettype);
+    ASSERT_NO_THROW(w.load(wallet_file.string(), "test"));
+    ASSERT_NO_THROW(w.store_to(file.string(), "test"));
+    ASSERT_NO_THROW(w.store());
+
+    // a small change goes to the delta log
+    w.set_tx_note(txid[0], "before");
+    ASSERT_NO_THROW(w.store());
+    ASSERT_TRUE(boost::filesystem::exists(delta_file));
+
+    // with or without further changes, the cache is written again under the new key
+    ASSERT_NO_THROW(w.change_password(file.string(), "test", "new"));
+    ASSERT_FALSE(boost::filesystem::exists(delta_file));
+    w.set_tx_note(txid[1], "after");
+    ASSERT_NO_THROW(w.store());
+    ASSERT_TRUE(boost::filesystem::exists(delta_file));
+  }
+
+  {
+    tools::wallet2 w(nettype);
+    ASSERT_NO_THROW(w.load(file.string(), "new"));
+    ASSERT_EQ(w.get_tx_note(txid[0]), "before");
+    ASSERT_EQ(w.get_tx_note(txid[1]), "after");
+    ASSERT_EQ(w.get_address_book().size(), 1);
+  }
+
+  boost::filesystem::remove_all(dir);
+}
+
 #define OUTPUT_EXPORT_FILE_MAGIC "Monero output export\003"
 TEST(Serialization, portability_outputs)
 {
@@ -0,0 +1,338 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <unordered_set>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/tx_pool.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+namespace
+{
+  const std::pair<uint8_t, uint64_t> hard_forks[] = {{1, 0}, {0, 0}};
+  const cryptonote::test_options test_options = {hard_forks, 0};
+}
+
+class tx_pool_snapshot: public ::testing::Test
+{
+protected:
+  tx_pool_snapshot(): pool(bc), bc(pool) {}
+
+  virtual void SetUp()
+  {
+    path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    cryptonote::BlockchainDB *db = new cryptonote::BlockchainLMDB();
+    db->open(path.string(), DBF_FAST);
+    ASSERT_TRUE(bc.init(db, cryptonote::FAKECHAIN, true, &test_options));
+    ASSERT_TRUE(pool.init());
+  }
+
+  virtual void TearDown()
+  {
+    bc.deinit();
+    boost::filesystem::remove_all(path);
+  }
+
+  // a tx whose inputs do not check out, which the pool keeps as if it came
+  // from a popped block
+  cryptonote::transaction add_tx(bool do_not_relay)
+  {
+    cryptonote::transaction tx;
+    tx.version = 2;
+    tx.vin.push_back(cryptonote::txin_to_key{0, {0}, crypto::rand<crypto::key_image>()});
+    tx.rct_signatures.type = rct::RCTTypeNull;
+    cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+    EXPECT_TRUE(pool.add_tx(tx, tvc, true, false, do_not_relay, 1));
+    EXPECT_TRUE(tvc.m_added_to_pool);
+    return tx;
+  }
+
+  std::shared_ptr<const cryptonote::tx_memory_pool::pool_snapshot> snapshot() const
+  {
+    return pool.get_snapshot();
+  }
+
+  // the txes readers used to get by walking the txpool table
+  std::unordered_set<crypto::hash> walk_db(bool include_unrelayed_txes) const
+  {
+    std::unordered_set<crypto::hash> txids;
+    bc.for_all_txpool_txes([&txids](const crypto::hash &txid, const cryptonote::txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+      txids.insert(txid);
+      return true;
+    }, false, include_unrelayed_txes);
+    return txids;
+  }
+
+  // the tx the pool itself holds, which block templates are checked on
+  const cryptonote::transaction *pool_tx(const crypto::hash &txid) const
+  {
+    return pool.m_pool_txs.at(txid).tx.get();
+  }
+
+  void fill_block_template()
+  {
+    cryptonote::block bl;
+    size_t total_weight;
+    uint64_t fee, expected_reward;
+    ASSERT_TRUE(pool.fill_block_template(bl, CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V5, 0, total_weight, fee, expected_reward, HF_VERSION_PER_BYTE_FEE));
+  }
+
+  // lets a tx whose inputs do not check out into block templates
+  void mark_ready(const crypto::hash &txid)
+  {
+    cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+    pool.m_input_cache[txid] = std::make_tuple(true, tvc, (uint64_t)0, bc.get_block_id_by_height(0));
+  }
+
+  bool update_block_template(cryptonote::block &bl, uint64_t pool_cookie, size_t &total_weight, uint64_t &fee)
+  {
+    uint64_t expected_reward;
+    return pool.update_block_template(bl, pool_cookie, CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V5, 0, total_weight, fee, expected_reward, HF_VERSION_PER_BYTE_FEE);
+  }
+
+  boost::filesystem::path path;
+  cryptonote::tx_memory_pool pool;
+  cryptonote::Blockchain bc;
+};
+
+TEST_F(tx_pool_snapshot, reused_while_the_pool_is_unchanged)
+{
+  add_tx(false);
+  add_tx(false);
+
+  const auto s = snapshot();
+  ASSERT_EQ(s->txs.size(), 2);
+  ASSERT_EQ(snapshot(), s);
+
+  std::vector<crypto::hash> txids;
+  pool.get_transaction_hashes(txids);
+  ASSERT_EQ(txids.size(), 2);
+  ASSERT_EQ(snapshot(), s);
+}
+
+TEST_F(tx_pool_snapshot, rebuilt_after_add_and_remove)
+{
+  const crypto::hash txid0 = cryptonote::get_transaction_hash(add_tx(false));
+  const auto s0 = snapshot();
+
+  add_tx(false);
+  const auto s1 = snapshot();
+  ASSERT_NE(s1, s0);
+  ASSERT_EQ(s1->txs.size(), 2);
+  ASSERT_EQ(s0->txs.size(), 1); // unchanged for readers still holding it
+
+  cryptonote::transaction tx;
+  cryptonote::blobdata blob;
+  size_t weight;
+  uint64_t fee;
+  bool relayed, do_not_relay, double_spend_seen, pruned;
+  ASSERT_TRUE(pool.take_tx(txid0, tx, blob, weight, fee, relayed, do_not_relay, double_spend_seen, pruned));
+  const auto s2 = snapshot();
+  ASSERT_NE(s2, s1);
+  ASSERT_EQ(s2->txs.size(), 1);
+  ASSERT_NE(s2->txs[0].txid, txid0);
+}
+
+TEST_F(tx_pool_snapshot, rebuilt_after_a_metadata_update)
+{
+  const cryptonote::transaction tx = add_tx(true);
+  const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+  const auto s0 = snapshot();
+  ASSERT_TRUE(s0->txs[0].meta.do_not_relay);
+  ASSERT_FALSE(s0->txs[0].meta.relayed);
+
+  // goes through update_pool_tx_meta, which leaves the cookie alone
+  const uint64_t cookie = pool.cookie();
+  pool.set_relayed({{txid, cryptonote::tx_to_blob(tx)}});
+  ASSERT_EQ(pool.cookie(), cookie);
+
+  const auto s1 = snapshot();
+  ASSERT_NE(s1, s0);
+  ASSERT_FALSE(s1->txs[0].meta.do_not_relay);
+  ASSERT_TRUE(s1->txs[0].meta.relayed);
+}
+
+TEST_F(tx_pool_snapshot, unrelayed_filtering_matches_the_db)
+{
+  for (int i = 0; i < 6; ++i)
+    add_tx(i % 3 == 0);
+
+  for (const bool include_unrelayed_txes: {false, true})
+  {
+    const std::unordered_set<crypto::hash> expected = walk_db(include_unrelayed_txes);
+    ASSERT_EQ(expected.size(), include_unrelayed_txes ? 6 : 4);
+
+    std::vector<crypto::hash> txids;
+    pool.get_transaction_hashes(txids, include_unrelayed_txes);
+    ASSERT_EQ(txids.size(), expected.size());
+    ASSERT_EQ(std::unordered_set<crypto::hash>(txids.begin(), txids.end()), expected);
+
+    std::vector<cryptonote::transaction> txs;
+    pool.get_transactions(txs, include_unrelayed_txes);
+    std::unordered_set<crypto::hash> tx_hashes;
+    for (const cryptonote::transaction &tx: txs)
+      tx_hashes.insert(cryptonote::get_transaction_hash(tx));
+    ASSERT_EQ(txs.size(), expected.size());
+    ASSERT_EQ(tx_hashes, expected);
+
+    std::vector<cryptonote::tx_backlog_entry> backlog;
+    pool.get_transaction_backlog(backlog, include_unrelayed_txes);
+    ASSERT_EQ(backlog.size(), expected.size());
+
+    cryptonote::txpool_stats stats;
+    pool.get_transaction_stats(stats, include_unrelayed_txes);
+    ASSERT_EQ(stats.txs_total, expected.size());
+    ASSERT_EQ(pool.get_transactions_count(include_unrelayed_txes), expected.size());
+  }
+
+  std::vector<cryptonote::rpc::tx_in_pool> tx_infos;
+  cryptonote::rpc::key_images_with_tx_hashes key_image_infos;
+  ASSERT_TRUE(pool.get_pool_for_rpc(tx_infos, key_image_infos));
+  std::unordered_set<crypto::hash> txids;
+  for (const cryptonote::rpc::tx_in_pool &txi: tx_infos)
+    txids.insert(txi.tx_hash);
+  ASSERT_EQ(tx_infos.size(), txids.size());
+  ASSERT_EQ(txids, walk_db(false));
+}
+
+TEST_F(tx_pool_snapshot, template_checks_leave_shared_txes_alone)
+{
+  for (int i = 0; i < 4; ++i)
+    add_tx(false);
+  const auto s = snapshot();
+
+  // readers copy the txes out of snapshots without the pool lock while
+  // block templates are checked and the pool changes
+  std::atomic<bool> stop(false);
+  boost::thread reader([this, &stop]() {
+    while (!stop)
+    {
+      std::vector<cryptonote::transaction> txs;
+      pool.get_transactions(txs);
+      std::vector<cryptonote::rpc::tx_in_pool> tx_infos;
+      cryptonote::rpc::key_images_with_tx_hashes key_image_infos;
+      pool.get_pool_for_rpc(tx_infos, key_image_infos);
+    }
+  });
+  for (int i = 0; i < 20; ++i)
+  {
+    fill_block_template();
+    add_tx(false);
+  }
+  stop = true;
+  reader.join();
+
+  // the template checked copies of its own
+  for (const auto &e: s->txs)
+  {
+    ASSERT_TRUE(e.tx);
+    ASSERT_NE(pool_tx(e.txid), e.tx.get());
+    ASSERT_EQ(cryptonote::get_transaction_hash(*e.tx), e.txid);
+  }
+}
+
+TEST_F(tx_pool_snapshot, template_update_adds_journalled_txes)
+{
+  const crypto::hash txid0 = cryptonote::get_transaction_hash(add_tx(false));
+  mark_ready(txid0);
+  const uint64_t cookie = pool.cookie();
+  const crypto::hash txid1 = cryptonote::get_transaction_hash(add_tx(false));
+  const crypto::hash txid2 = cryptonote::get_transaction_hash(add_tx(false));
+  mark_ready(txid1);
+  mark_ready(txid2);
+
+  // only what was added after the template was made is offered
+  cryptonote::block bl;
+  size_t total_weight;
+  uint64_t fee;
+  ASSERT_TRUE(update_block_template(bl, cookie, total_weight, fee));
+  ASSERT_EQ(bl.tx_hashes.size(), 2);
+  ASSERT_EQ(std::unordered_set<crypto::hash>(bl.tx_hashes.begin(), bl.tx_hashes.end()), std::unordered_set<crypto::hash>({txid1, txid2}));
+  ASSERT_GT(total_weight, 0);
+
+  // and offered again to a template made before them, without duplicates
+  bl.tx_hashes = {txid1};
+  ASSERT_TRUE(update_block_template(bl, cookie, total_weight, fee));
+  ASSERT_EQ(bl.tx_hashes.size(), 2);
+  ASSERT_EQ(bl.tx_hashes[0], txid1);
+  ASSERT_EQ(bl.tx_hashes[1], txid2);
+}
+
+TEST_F(tx_pool_snapshot, template_update_evicts_removed_txes)
+{
+  const crypto::hash txid0 = cryptonote::get_transaction_hash(add_tx(false));
+  const crypto::hash txid1 = cryptonote::get_transaction_hash(add_tx(false));
+  mark_ready(txid0);
+  mark_ready(txid1);
+
+  cryptonote::block bl;
+  size_t total_weight;
+  uint64_t fee;
+  ASSERT_TRUE(update_block_template(bl, 0, total_weight, fee));
+  ASSERT_EQ(bl.tx_hashes.size(), 2);
+  const size_t full_weight = total_weight;
+  const uint64_t cookie = pool.cookie();
+
+  cryptonote::transaction tx;
+  cryptonote::blobdata blob;
+  size_t weight;
+  uint64_t tx_fee;
+  bool relayed, do_not_relay, double_spend_seen, pruned;
+  ASSERT_TRUE(pool.take_tx(txid0, tx, blob, weight, tx_fee, relayed, do_not_relay, double_spend_seen, pruned));
+
+  ASSERT_TRUE(update_block_template(bl, cookie, total_weight, fee));
+  ASSERT_EQ(bl.tx_hashes, std::vector<crypto::hash>({txid1}));
+  ASSERT_EQ(total_weight, full_weight - weight);
+}
+
+TEST_F(tx_pool_snapshot, template_update_falls_back_after_a_block)
+{
+  const uint64_t cookie = pool.cookie();
+  mark_ready(cryptonote::get_transaction_hash(add_tx(false)));
+
+  // the journal is cleared with each block, so older templates are rebuilt
+  ASSERT_TRUE(pool.on_blockchain_inc(1, bc.get_block_id_by_height(0)));
+  cryptonote::block bl;
+  size_t total_weight;
+  uint64_t fee;
+  ASSERT_FALSE(update_block_template(bl, cookie, total_weight, fee));
+  ASSERT_TRUE(bl.tx_hashes.empty());
+
+  // while templates made since are still updated
+  const uint64_t new_cookie = pool.cookie();
+  const crypto::hash txid = cryptonote::get_transaction_hash(add_tx(false));
+  mark_ready(txid);
+  ASSERT_TRUE(update_block_template(bl, new_cookie, total_weight, fee));
+  ASSERT_EQ(bl.tx_hashes, std::vector<crypto::hash>({txid}));
+}
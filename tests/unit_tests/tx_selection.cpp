@@ -0,0 +1,140 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <vector>
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_core/tx_selection.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  const uint8_t version = 12;
+  const size_t median_weight = CRYPTONOTE_BLOCK_GRANTED_FULL_REWARD_ZONE_V5;
+  const size_t max_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+
+  std::vector<template_candidate> make_pool(uint64_t seed, size_t count)
+  {
+    uint64_t base_reward;
+    get_block_reward(median_weight, 0, 0, base_reward, version);
+    auto next = [&seed]() { seed = seed * 6364136223846793005ull + 1442695040888963407ull; return seed >> 33; };
+    std::vector<template_candidate> candidates;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const size_t weight = next() % 8 ? 1500 + next() % 2000 : 10000 + next() % 40000;
+      candidates.push_back({weight, weight * (base_reward / 1000000000 * (1 + next() % 1000))});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const template_candidate &a, const template_candidate &b) {
+      return a.fee / (double)a.weight > b.fee / (double)b.weight;
+    });
+    return candidates;
+  }
+
+  uint64_t get_revenue(const std::vector<template_candidate> &candidates, const std::vector<size_t> &selected, const block_reward_curve &curve, size_t &weight)
+  {
+    uint64_t fee = 0, reward = 0;
+    weight = 0;
+    for (size_t i: selected)
+    {
+      weight += candidates[i].weight;
+      fee += candidates[i].fee;
+    }
+    curve.get(weight, reward);
+    return reward + fee;
+  }
+}
+
+TEST(tx_selection, reward_curve_matches_get_block_reward)
+{
+  const block_reward_curve curve(median_weight, 0, version);
+  for (size_t weight = 0; weight <= 2 * median_weight + 1000; weight += 997)
+  {
+    uint64_t expected = 0, reward = 0;
+    const bool r = get_block_reward(median_weight, weight, 0, expected, version);
+    ASSERT_EQ(r, curve.get(weight, reward));
+    if (r)
+      ASSERT_EQ(expected, reward);
+  }
+}
+
+TEST(tx_selection, takes_everything_which_fits)
+{
+  const block_reward_curve curve(median_weight, 0, version);
+  const std::vector<template_candidate> candidates = {{2000, 5000000}, {3000, 6000000}, {1500, 2000000}};
+  std::vector<size_t> selected;
+  select_template_txes(candidates, curve, max_weight, selected);
+  ASSERT_EQ(std::vector<size_t>({0, 1, 2}), selected);
+}
+
+TEST(tx_selection, greedy_when_the_block_cannot_pass_the_median)
+{
+  const block_reward_curve curve(median_weight, 0, version);
+  const std::vector<template_candidate> candidates = {{60, 70}, {50, 50}, {50, 50}};
+  std::vector<size_t> greedy, selected;
+  const uint64_t greedy_revenue = select_template_txes_greedy(candidates, curve, 100, greedy);
+  const uint64_t revenue = select_template_txes(candidates, curve, 100, selected);
+  ASSERT_EQ(std::vector<size_t>({0}), greedy);
+  ASSERT_EQ(greedy, selected);
+  ASSERT_EQ(greedy_revenue, revenue);
+}
+
+TEST(tx_selection, beats_greedy_in_the_penalty_zone)
+{
+  const block_reward_curve curve(median_weight, 0, version);
+  const std::vector<template_candidate> candidates = make_pool(2, 100);
+  std::vector<size_t> greedy, selected;
+  const uint64_t greedy_revenue = select_template_txes_greedy(candidates, curve, max_weight, greedy);
+  const uint64_t revenue = select_template_txes(candidates, curve, max_weight, selected);
+  size_t greedy_weight, weight;
+  ASSERT_EQ(greedy_revenue, get_revenue(candidates, greedy, curve, greedy_weight));
+  ASSERT_EQ(revenue, get_revenue(candidates, selected, curve, weight));
+  ASSERT_GT(greedy_weight, median_weight);
+  ASSERT_GT(revenue, greedy_revenue);
+}
+
+TEST(tx_selection, never_worse_than_greedy)
+{
+  const block_reward_curve curve(median_weight, 0, version);
+  for (uint64_t seed = 1; seed <= 8; ++seed)
+  {
+    const std::vector<template_candidate> candidates = make_pool(seed, 2000);
+    std::vector<size_t> greedy, selected;
+    const uint64_t greedy_revenue = select_template_txes_greedy(candidates, curve, max_weight, greedy);
+    const uint64_t revenue = select_template_txes(candidates, curve, max_weight, selected);
+    ASSERT_GE(revenue, greedy_revenue);
+
+    size_t weight;
+    ASSERT_EQ(revenue, get_revenue(candidates, selected, curve, weight));
+    ASSERT_LE(weight, max_weight);
+    ASSERT_TRUE(std::is_sorted(selected.begin(), selected.end()));
+    ASSERT_TRUE(std::adjacent_find(selected.begin(), selected.end()) == selected.end());
+  }
+}
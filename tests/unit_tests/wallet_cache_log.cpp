@@ -0,0 +1,116 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "wallet/cache_log.h"
+#include "serialization/binary_utils.h"
+
+static std::string random_string(size_t size)
+{
+  std::string s(size, '\0');
+  crypto::generate_random_bytes_not_thread_safe(size, &s[0]);
+  return s;
+}
+
+static size_t chunks_size(const tools::wallet_cache_log::record &rec)
+{
+  size_t size = 0;
+  for (const auto &c: rec.chunks)
+    size += c.size();
+  return size;
+}
+
+TEST(wallet_cache_log, split)
+{
+  const std::string stream = random_string(1000000);
+  const auto chunks = tools::wallet_cache_log::split(stream);
+  ASSERT_GT(chunks.size(), 1);
+  size_t offset = 0;
+  for (const auto &c: chunks)
+  {
+    ASSERT_EQ(c.first, offset);
+    ASSERT_GT(c.second, 0);
+    ASSERT_LE(c.second, 65536);
+    offset += c.second;
+  }
+  ASSERT_EQ(offset, stream.size());
+  ASSERT_TRUE(tools::wallet_cache_log::split(std::string()).empty());
+}
+
+TEST(wallet_cache_log, incremental)
+{
+  tools::wallet_cache_log log;
+  tools::wallet_cache_log::record rec;
+  std::vector<tools::wallet_cache_log::record> records;
+
+  const std::string base = random_string(1000000);
+  log.reset(base);
+  ASSERT_FALSE(log.make_record(base, rec));
+
+  // an insertion in the middle only costs the chunks around it
+  std::string stream = base;
+  stream.insert(400000, random_string(100));
+  ASSERT_TRUE(log.make_record(stream, rec));
+  ASSERT_LT(chunks_size(rec), 200000);
+  log.commit(rec);
+  records.push_back(rec);
+  ASSERT_FALSE(log.make_record(stream, rec));
+
+  stream += random_string(5000);
+  stream[100] ^= 1;
+  ASSERT_TRUE(log.make_record(stream, rec));
+  ASSERT_LT(chunks_size(rec), 200000);
+  log.commit(rec);
+  records.push_back(rec);
+
+  // records go through the binary archive on disk
+  for (auto &r: records)
+  {
+    std::string blob;
+    ASSERT_TRUE(::serialization::dump_binary(r, blob));
+    r = tools::wallet_cache_log::record();
+    ASSERT_TRUE(::serialization::parse_binary(blob, r));
+  }
+
+  tools::wallet_cache_log loaded;
+  std::string replayed;
+  ASSERT_EQ(loaded.replay(base, records, replayed), 2);
+  ASSERT_EQ(replayed, stream);
+  ASSERT_FALSE(loaded.make_record(stream, rec));
+
+  // a damaged record stops the replay
+  records[1].chunks.clear();
+  ASSERT_EQ(loaded.replay(base, records, replayed), 1);
+  ASSERT_EQ(replayed.size(), base.size() + 100);
+
+  // records written over another full cache are ignored
+  ASSERT_EQ(loaded.replay(stream, records, replayed), 0);
+  ASSERT_EQ(replayed, stream);
+}
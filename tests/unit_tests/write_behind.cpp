@@ -0,0 +1,158 @@
+// Copyright (c) 2021-2024, The GNTL Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "gtest/gtest.h"
+
+#include "blockchain_db/write_behind.h"
+
+namespace
+{
+  // records what the writer and the flush thread do, in order
+  class journal
+  {
+  public:
+    void add(const std::string &event) { boost::lock_guard<boost::mutex> lock(m_mutex); m_events.push_back(event); }
+    std::vector<std::string> events() { boost::lock_guard<boost::mutex> lock(m_mutex); return m_events; }
+
+  private:
+    boost::mutex m_mutex;
+    std::vector<std::string> m_events;
+  };
+}
+
+TEST(write_behind, not_started)
+{
+  std::atomic<int> syncs(0);
+  cryptonote::write_behind flusher([&](){ ++syncs; return 0; });
+  ASSERT_FALSE(flusher.running());
+  flusher.queue();
+  ASSERT_EQ(flusher.wait(), 0);
+  ASSERT_EQ(flusher.stop(), 0);
+  ASSERT_EQ(syncs, 0);
+}
+
+TEST(write_behind, write_ordering)
+{
+  journal j;
+  cryptonote::write_behind flusher([&](){
+    j.add("flush start");
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    j.add("flush end");
+    return 0;
+  });
+  flusher.start();
+  ASSERT_TRUE(flusher.running());
+
+  // a commit never starts while the previous one is still being flushed
+  for (int i = 0; i < 5; ++i)
+  {
+    ASSERT_EQ(flusher.wait(), 0);
+    j.add("commit");
+    flusher.queue();
+  }
+  ASSERT_EQ(flusher.wait(), 0);
+
+  std::vector<std::string> expected;
+  for (int i = 0; i < 5; ++i)
+  {
+    expected.push_back("commit");
+    expected.push_back("flush start");
+    expected.push_back("flush end");
+  }
+  ASSERT_EQ(j.events(), expected);
+  ASSERT_EQ(flusher.stop(), 0);
+}
+
+TEST(write_behind, error_goes_to_next_commit)
+{
+  std::atomic<int> syncs(0);
+  cryptonote::write_behind flusher([&](){ return ++syncs == 1 ? 5 : 0; });
+  flusher.start();
+
+  flusher.queue();
+  ASSERT_EQ(flusher.wait(), 5);
+  // reported once only
+  ASSERT_EQ(flusher.wait(), 0);
+
+  flusher.queue();
+  ASSERT_EQ(flusher.wait(), 0);
+  ASSERT_EQ(syncs, 2);
+  ASSERT_EQ(flusher.stop(), 0);
+}
+
+TEST(write_behind, stop_drains)
+{
+  std::atomic<int> syncs(0);
+  cryptonote::write_behind flusher([&](){
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    ++syncs;
+    return 0;
+  });
+  flusher.start();
+  flusher.queue();
+  ASSERT_EQ(flusher.stop(), 0);
+  ASSERT_EQ(syncs, 1);
+  ASSERT_FALSE(flusher.running());
+
+  // nothing pending, nothing flushed
+  flusher.start();
+  ASSERT_EQ(flusher.stop(), 0);
+  ASSERT_EQ(syncs, 1);
+}
+
+TEST(write_behind, stop_reports_last_error)
+{
+  cryptonote::write_behind flusher([](){
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    return 7;
+  });
+  flusher.start();
+  flusher.queue();
+  ASSERT_EQ(flusher.stop(), 7);
+}
+
+TEST(write_behind, destructor_drains)
+{
+  std::atomic<int> syncs(0);
+  {
+    cryptonote::write_behind flusher([&](){
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+      ++syncs;
+      return 0;
+    });
+    flusher.start();
+    flusher.queue();
+  }
+  ASSERT_EQ(syncs, 1);
+}